@@ -1,10 +1,18 @@
-import argparse, gzip
+import argparse, gzip, io, json
 import numpy as np
 import matplotlib.pyplot as plt
 from collections import Counter
 
 
 def open_file(filename):
+    if filename.endswith(".zst"):
+        # needs the zstandard package, the results are a sequence of frames
+        import zstandard
+
+        reader = zstandard.ZstdDecompressor().stream_reader(
+            open(filename, "rb"), read_across_frames=True, closefd=True
+        )
+        return io.TextIOWrapper(reader)
     open_func = gzip.open if filename.endswith(".gz") else open
     return open_func(filename, "rt")
 
@@ -28,8 +36,16 @@ class csvdata:
         self.fenwdl = {}  # dict with mapping fenkey -> [fen, W, D, L]
         self.book = None
         self.prefix = None
+        self.precomputed = False
+        self.results = None
         if not filename:
             return
+        if filename.endswith(".json"):
+            self.load_histograms(filename)
+            return
+        if filename.endswith(".bin"):
+            self.load_results(filename)
+            return
         self.prefix, _, _ = filename.rpartition(".csv")
         with open_file(filename) as f:
             for line in f:
@@ -47,6 +63,31 @@ class csvdata:
                 for i in [1, 2, 3]:
                     self.fenwdl[key][i] += int(fields[i])
 
+    def load_histograms(self, filename):
+        # written by build/src/analysis --postProcess, the statistics are already computed
+        self.prefix, _, _ = filename.rpartition(".json")
+        with open_file(filename) as f:
+            data = json.load(f)
+        self.set_histograms(data)
+
+    def load_results(self, filename):
+        # written by build/src/analysis --binary, the analysis_results module maps it and
+        # computes the histograms natively
+        import analysis_results
+
+        self.prefix, _, _ = filename.rpartition(".bin")
+        self.results = analysis_results.open(filename)
+        self.set_histograms(self.results.histograms())
+
+    def set_histograms(self, data):
+        self.drawrate = Counter({int(k): v for k, v in data["drawrate"].items()})
+        self.depth = Counter({int(k): v for k, v in data["depth"].items()})
+        self.games = Counter({int(k): v for k, v in data["games"].items()})
+        self.pos_count = data["positions"]
+        self.total_count = data["total_games"]
+        self.white_count = data["white_games"]
+        self.precomputed = True
+
     def load_book(self, bookFile):
         self.book = []
         with open_file(bookFile) as f:
@@ -289,7 +330,7 @@ if __name__ == "__main__":
     parser.add_argument(
         "filenames",
         nargs="*",
-        help="File with FEN WDL statistics.",
+        help="File with FEN WDL statistics, the histograms.json written by build/src/analysis --postProcess, or the results.bin of --binary (needs the analysis_results module).",
         default=["results.csv"],
     )
     parser.add_argument(
@@ -336,9 +377,39 @@ if __name__ == "__main__":
         )
         exit(1)
 
+    if any(f.endswith(".bin") for f in args.filenames) and (
+        args.bookFile is not None or args.cdbFile is not None
+    ):
+        print("--bookFile and --cdbFile need the FENs of a .csv file.")
+        exit(1)
+
+    if any(f.endswith(".json") for f in args.filenames) and (
+        args.drawRateMin is not None
+        or args.drawRateMax is not None
+        or args.bookFile is not None
+        or args.cdbFile is not None
+    ):
+        print(
+            "Histograms from --postProcess can only be plotted, filter with build/src/analysis --drawRateMin/--drawRateMax instead."
+        )
+        exit(1)
+
     csvs = []
     for f in args.filenames:
         csv = csvdata(f)
+        if csv.results is not None and (
+            args.drawRateMin is not None or args.drawRateMax is not None
+        ):
+            count = csv.results.filter_exits(
+                args.outFile, args.drawRateMin, args.drawRateMax, args.drawRateGames
+            )
+            epdFile, _, _ = args.outFile.rpartition(".csv")
+            print(
+                f"Saved {count} filtered positions and stats to {epdFile}.epd and {args.outFile}."
+            )
+        if csv.precomputed:
+            csvs.append(csv)
+            continue
         if args.bookFile:
             csv.load_book(args.bookFile)
             count = csv.add_unseen_exits()
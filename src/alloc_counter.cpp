@@ -0,0 +1,71 @@
+#include "alloc_counter.hpp"
+
+#include <cstdint>
+
+#ifdef COUNT_ALLOCATIONS
+#    include <algorithm>
+#    include <cstdlib>
+#    include <new>
+
+namespace {
+// a plain integer needs no dynamic initialization, so it can be used by the very first new
+thread_local std::uint64_t allocations = 0;
+
+void *allocate(std::size_t size) noexcept {
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void *allocate(std::size_t size, std::align_val_t align) noexcept {
+    allocations++;
+
+    // aligned_alloc wants a multiple of the alignment
+    const auto alignment = std::max(static_cast<std::size_t>(align), sizeof(void *));
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+template <typename... Args>
+void *allocate_or_throw(Args... args) {
+    void *p = allocate(args...);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+}  // namespace
+
+void *operator new(std::size_t size) { return allocate_or_throw(size); }
+void *operator new[](std::size_t size) { return allocate_or_throw(size); }
+void *operator new(std::size_t size, std::align_val_t align) {
+    return allocate_or_throw(size, align);
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+    return allocate_or_throw(size, align);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return allocate(size, align);
+}
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return allocate(size, align);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+std::uint64_t thread_allocations() noexcept { return allocations; }
+#else
+std::uint64_t thread_allocations() noexcept { return 0; }
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// builds with -Dcount_allocations=true replace the global operator new to count allocations
+#ifdef COUNT_ALLOCATIONS
+constexpr bool COUNTS_ALLOCATIONS = true;
+#else
+constexpr bool COUNTS_ALLOCATIONS = false;
+#endif
+
+/// @brief Heap allocations made by the calling thread so far.
+/// @return always 0 unless COUNTS_ALLOCATIONS
+[[nodiscard]] std::uint64_t thread_allocations() noexcept;
@@ -1,103 +1,358 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <regex>
 #include <set>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "../external/chess.hpp"
-#include "../external/gzip/gzstream.h"
-#include "../external/parallel_hashmap/phmap.h"
-#include "../external/threadpool.hpp"
+#include "./alloc_counter.hpp"
+#include "./approx.hpp"
+#include "./cache.hpp"
+#include "./checkpoint.hpp"
+#include "./dir_watcher.hpp"
+#include "./fen_normalizer.hpp"
+#include "./file_scan.hpp"
+#include "./game_headers.hpp"
+#include "./groups.hpp"
+#include "./gz_reader.hpp"
+#include "./metadata.hpp"
+#include "./numa.hpp"
+#include "./opening_tree.hpp"
 #include "./options.hpp"
+#include "./pgn_scanner.hpp"
+#include "./pipeline.hpp"
+#include "./post_process.hpp"
+#include "./progress.hpp"
+#include "./result_file.hpp"
+#include "./result_server.hpp"
+#include "./results.hpp"
+#include "./run_stats.hpp"
+#include "./scheduler.hpp"
+#include "./spill.hpp"
+#include "./statistics.hpp"
 #include "./test.hpp"
+#include "./trace.hpp"
 #include "./utils.hpp"
 
 using namespace chess;
 namespace fs = std::filesystem;
 using json   = nlohmann::json;
 
-enum class Result { WIN = 'W', DRAW = 'D', LOSS = 'L', UNKNOWN = 'U' };
+map_t occurance_map                   = {};
+std::atomic<std::size_t> total_games  = 0;
+std::atomic<std::size_t> total_cached = 0;
 
-struct Statistics {
-    size_t wins   = 0;
-    size_t draws  = 0;
-    size_t losses = 0;
+// mapped files are scanned in blocks of this size, so that the progress moves on within a file
+constexpr std::size_t MAPPED_BLOCK_SIZE = 1 << 24;
 
-    double draw_rate() const { return double(draws) / total(); }
+// how often --serve looks for new files if no change was reported
+constexpr std::chrono::milliseconds SERVE_INTERVAL(1000);
 
-    // for sorting according to draw rate
+// private maps of the worker threads with --localMaps, merged into occurance_map at the end
+class WorkerMaps {
+   public:
+    map_t &get() {
+        const std::lock_guard<std::mutex> lock(mutex);
 
-    bool operator<(const Statistics &other) const {
-        if (draw_rate() == other.draw_rate()) {
-            if (total() == other.total()) {
-                if (wins == other.wins) {
-                    if (draws == other.draws) {
-                        return losses > other.losses;
-                    }
-                    return draws > other.draws;
-                }
-                return wins > other.wins;
-            }
-            return total() > other.total();
+        auto &stats_map = maps[std::this_thread::get_id()];
+
+        if (!stats_map) stats_map = std::make_unique<map_t>();
+
+        return *stats_map;
+    }
+
+    std::vector<map_t *> all() {
+        const std::lock_guard<std::mutex> lock(mutex);
+
+        std::vector<map_t *> result;
+
+        for (auto &[id, stats_map] : maps) {
+            result.push_back(stats_map.get());
         }
-        return draw_rate() < other.draw_rate();
+
+        return result;
+    }
+
+    void clear() {
+        const std::lock_guard<std::mutex> lock(mutex);
+        maps.clear();
     }
 
-    size_t total() const { return wins + draws + losses; }
+   private:
+    std::mutex mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<map_t>> maps;
 };
 
-using map_t = phmap::parallel_flat_hash_map<
-    std::string, Statistics, std::hash<std::string>, std::equal_to<std::string>,
-    std::allocator<std::pair<const std::string, Statistics>>, 8, std::mutex>;
-using map_meta = std::unordered_map<std::string, TestMetaData>;
+WorkerMaps worker_maps;
 
-map_t occurance_map                   = {};
-std::atomic<std::size_t> total_chunks = 0;
-std::atomic<std::size_t> total_games  = 0;
+// the nodes of --numa, the workers pinned to a node add to its map, which is merged into
+// occurance_map at the end
+NumaTopology numa_topology;
+std::vector<std::unique_ptr<map_t>> node_maps;
+thread_local std::size_t numa_node = 0;
+
+// the statistics of each group with --groupBy, occurance_map stays empty then
+GroupMaps group_maps;
+
+RunStats run_stats;
+
+// every position up to --treeDepth plies after the book exits
+tree_map_t tree_map;
+
+// the runs on disk with --spill
+std::unique_ptr<SpilledResults> spilled_results;
+
+// the sketches of --approx, and the share of the input which was sampled
+std::unique_ptr<ApproxCounter> approx_counter;
+nlohmann::json approx_sample = nlohmann::json::object();
+double approx_scale          = 1;
+
+// the finished files of --checkpoint, a file is merged through it
+std::unique_ptr<Checkpointer> checkpoints;
+
+/// @brief The map the games of a file are added to, unless they are grouped per game.
+/// @param options
+/// @param file
+/// @return
+map_t &file_target(const CLIOptions &options, const std::string &file) {
+    if (!options.group_by.empty()) return group_maps.get(group_maps.group_of(file));
+
+    if (options.local_maps) return worker_maps.get();
+
+    return node_maps.empty() ? occurance_map : *node_maps[numa_node];
+}
+
+/// @brief Pins a worker of --numa to its node. The buffers the worker allocates, and the
+/// buckets of the node map it adds first, are placed on that node then.
+/// @param worker
+void pin_worker(std::size_t worker) {
+    numa_node = numa_topology.node_of(worker);
+
+    if (numa_topology.bind_thread(numa_node)) {
+        thread_stats().numa_node = static_cast<int>(numa_node);
+        return;
+    }
 
+    static std::once_flag warned;
+
+    std::call_once(warned, []() {
+        std::cerr << "Warning: could not pin the workers to their NUMA nodes" << std::endl;
+    });
+}
+
+/// @brief Adds the statistics of a finished file with merge, a checkpoint of --checkpoint has
+/// either all of them or none.
+/// @param file
+/// @param games
+/// @param merge
+template <typename MERGE>
+void complete_file(const std::string &file, std::size_t games, MERGE &&merge) {
+    // includes waiting for the map, or for a checkpoint which is being taken
+    const TraceSpan span("merge", file);
+
+    if (checkpoints) {
+        checkpoints->complete(file, games, merge);
+    } else {
+        merge();
+    }
+}
+
+/// @brief Moves occurance_map to disk once it grows beyond the limit of --spill, called
+/// whenever a file is done.
+/// @param options
+void bound_memory(const CLIOptions &options) {
+    if (spilled_results) spilled_results->maybe_spill(occurance_map, options.concurrency);
+}
+
+/// @brief Group of the file if its games are grouped by a header, otherwise nullptr.
+/// @param options
+/// @param file
+/// @return
+const std::string *game_groups(const CLIOptions &options, const std::string &file) {
+    return groups_per_game(options.group_by) ? &group_maps.group_of(file) : nullptr;
+}
+
+/// @brief Adds the games of a file to a map. An Analyzer is meant to be reused for many files
+/// through start_file(), so that nothing is allocated per game: the header values are views
+/// into the buffer of the parser, and the keys are packed into fixed size PositionKeys. The
+/// games are read by a FeatureAnalyzer, create() picks the one for the options of the run.
 class Analyzer : public pgn::Visitor {
    public:
-    Analyzer(const CLIOptions &options) : options(options) {}
+    /// @brief The features of the options which change how a game is read. Each set of them
+    /// has an Analyzer of its own, so that a feature which is not used costs nothing per game.
+    enum Feature : unsigned {
+        FIX_FENS     = 1 << 0,  // --fixFENsource
+        FILTER       = 1 << 1,  // --filter
+        TREE         = 1 << 2,  // --treeDepth
+        GAME_GROUPS  = 1 << 3,  // --groupBy with a group per game
+        FEATURE_SETS = 1 << 4
+    };
+
     virtual ~Analyzer(){};
 
+    /// @brief The Analyzer for the features of options.
+    /// @param options
+    /// @return
+    [[nodiscard]] static std::unique_ptr<Analyzer> create(const CLIOptions &options);
+
+    /// @brief Starts the next file, the games of the previous one are no longer counted.
+    /// @param target
+    /// @param file_group group of the file if its games are grouped by a header
+    void start_file(map_t &target, const std::string *file_group) {
+        stats_map    = &target;
+        group        = file_group;
+        group_map    = nullptr;
+        copy_headers = false;
+        game_count   = 0;
+    }
+
+    /// @brief For a parser which reuses the buffer of a header value for the next header, the
+    /// values are copied until the next file then.
+    void copy_header_values() { copy_headers = true; }
+
+    std::size_t games() const { return game_count; }
+
+   protected:
+    Analyzer(const CLIOptions &options) : options(options), stats(thread_stats()) {}
+
+    static constexpr std::size_t INSERT_SAMPLE = 16;
+
+    // a sampled insert which takes longer waited for the lock of its submap, or for a rehash,
+    // and is a span of --trace
+    static constexpr double TRACED_INSERT = 1e-5;
+
+    // a header value is only copied if the parser would overwrite it
+    std::string_view keep(std::string &buffer, std::string_view value) {
+        if (!copy_headers) return value;
+
+        buffer.assign(value);
+        return buffer;
+    }
+
+    Result result = Result::UNKNOWN;
+    std::string_view fen;
+    std::string_view termination;
+    std::string_view time_control;
+    std::string fen_buffer;
+    std::string termination_buffer;
+    std::string time_control_buffer;
+    bool copy_headers = false;
+    GameFilter::State filter_state;
+    Board board;
+    std::uint32_t tree_ply    = 0;
+    bool valid_game           = true;
+    std::size_t game_count    = 0;
+    std::uint64_t allocations = 0;
+    const CLIOptions &options;
+    map_t *stats_map = nullptr;
+    ThreadStats &stats;
+
+    const std::string *group = nullptr;
+    std::string group_tc;
+    map_t *group_map = nullptr;
+};
+
+/// @brief An Analyzer with the features of FEATURES compiled in, the checks of the other
+/// features are left out of the visitor.
+template <unsigned FEATURES>
+class FeatureAnalyzer final : public Analyzer {
+   public:
+    FeatureAnalyzer(const CLIOptions &options) : Analyzer(options) {}
+
     // reset
     void startPgn() override {
-        result     = Result::UNKNOWN;
-        fen        = chess::constants::STARTPOS;
-        valid_game = true;
+        if constexpr (COUNTS_ALLOCATIONS) allocations = thread_allocations();
+
+        result       = Result::UNKNOWN;
+        fen          = chess::constants::STARTPOS;
+        valid_game   = true;
+        termination  = {};
+        time_control = {};
+
+        if constexpr (has(FILTER)) options.filter.start(filter_state);
     }
 
     void header(std::string_view key, std::string_view value) override {
-        if (key == "Result") {
-            if (value == "1-0") {
-                result = Result::WIN;
-            } else if (value == "0-1") {
-                result = Result::LOSS;
-            } else if (value == "1/2-1/2") {
-                result = Result::DRAW;
-            }
-        } else if (key == "FEN") {
-            fen = value;
-        } else if (key == "Termination") {
-            if (value == "time forfeit" || value == "abandoned" || value == "stalled connection" ||
-                value == "illegal move" || value == "unterminated") {
-                valid_game = false;
+        // a game which fails the filter is dropped right away, without reading further headers
+        if constexpr (has(FILTER)) {
+            if (!options.filter.header(filter_state, key, value)) {
+                stats.filtered++;
+                skipPgn(true);
+                return;
             }
         }
+
+        switch (header_key(key)) {
+            case HeaderKey::RESULT:
+                if (const auto parsed = parse_result(value); parsed != Result::UNKNOWN) {
+                    result = parsed;
+                }
+                break;
+            case HeaderKey::FEN:
+                fen = keep(fen_buffer, value);
+                break;
+            case HeaderKey::TIME_CONTROL:
+                // only the groups of a game need the time control
+                if constexpr (has(GAME_GROUPS)) time_control = keep(time_control_buffer, value);
+                break;
+            case HeaderKey::TERMINATION:
+                termination = keep(termination_buffer, value);
+
+                if (aborted_termination(value)) valid_game = false;
+                break;
+            case HeaderKey::OTHER:
+                break;
+        }
     }
 
     // last fen was parsed
     void startMoves() override {
         skipPgn(true);
 
-        if (result == Result::UNKNOWN || !valid_game) return;
+        if constexpr (has(FILTER)) {
+            if (!options.filter.finish(filter_state)) {
+                stats.filtered++;
+                return;
+            }
+        }
+
+        if (!valid_game) {
+            stats.count_game(termination, false);
+            return;
+        }
+
+        if (result == Result::UNKNOWN) {
+            stats.no_result++;
+            return;
+        }
+
+        const auto key = fixFen(fen);
 
-        const auto fixed_fen = fixFen(fen);
+        if (approx_counter) {
+            approx_counter->add(key, result);
 
-        occurance_map.lazy_emplace_l(
-            fixed_fen,
+            stats.count_game(termination, true);
+            game_count++;
+            return;
+        }
+
+        // reading the clock for every insert would cost about as much as the insert itself
+        using clock        = std::chrono::steady_clock;
+        const bool sampled = game_count % INSERT_SAMPLE == 0;
+        const auto t0      = sampled ? clock::now() : clock::time_point();
+
+        target().lazy_emplace_l(
+            key,
             [&](map_t::value_type &v) {
                 if (result == Result::WIN) {
                     v.second.wins++;
@@ -108,97 +363,257 @@ class Analyzer : public pgn::Visitor {
                 }
             },
             [&](const map_t::constructor &ctor) {
-                ctor(fixed_fen, Statistics{result == Result::WIN, result == Result::DRAW,
-                                           result == Result::LOSS});
+                ctor(key, Statistics{result == Result::WIN, result == Result::DRAW,
+                                      result == Result::LOSS});
             });
 
-        total_games++;
+        if (sampled) {
+            const std::chrono::duration<double> elapsed = clock::now() - t0;
+            stats.insert += INSERT_SAMPLE * elapsed.count();
+
+            if (Trace::enabled() && elapsed.count() >= TRACED_INSERT) {
+                Trace::add_ending_now("insert", elapsed.count());
+            }
+        }
+
+        stats.count_game(termination, true);
+        game_count++;
+
+        if constexpr (has(TREE)) {
+            // the game is counted, but a position the move generator cannot handle is not
+            // replayed
+            if (!set_tree_board(fen)) {
+                stats.invalid_tree_position++;
+                return;
+            }
+
+            // the tree is written with the FEN of the board for a FEN which is kept as text
+            tree_ply = 0;
+            add_tree_node(key.is_raw() ? std::nullopt
+                                       : std::optional<PositionKey>(key.without_counters()));
+
+            skipPgn(false);
+        }
     }
 
-    void move(std::string_view, std::string_view) override {}
+    // only called with --treeDepth, the game is skipped once the depth is reached
+    void move(std::string_view san, std::string_view) override {
+        if constexpr (has(TREE)) {
+            Move move = Move::NO_MOVE;
+
+            try {
+                move = uci::parseSan(board, san);
+            } catch (const std::exception &) {
+            }
+
+            if (move == Move::NO_MOVE) {
+                skipPgn(true);
+                return;
+            }
+
+            board.makeMove(move);
+            tree_ply++;
+            add_tree_node(std::nullopt);
+
+            if (tree_ply >= options.tree_depth) skipPgn(true);
+        } else {
+            (void)san;
+            skipPgn(true);
+        }
+    }
 
-    void endPgn() override {}
+    void endPgn() override {
+        if constexpr (COUNTS_ALLOCATIONS) {
+            stats.game_allocations += thread_allocations() - allocations;
+            stats.measured_games++;
+        }
+    }
 
    private:
-    std::string fixFen(std::string_view fen_view) {
-        std::regex p("^(.+) 0 1$");
-        std::smatch match;
-        std::string value_str(fen_view);
-
-        // revert changes by cutechess-cli to move counters
-        if (!options.fixfens.empty() && std::regex_search(value_str, match, p) &&
-            match.size() > 1) {
-            std::string fen = match[1];
-            auto it         = options.fixfens.find(fen);
-
-            if (it == options.fixfens.end()) {
-                std::cerr << "Could not find FEN " << fen << " in fixFENsource." << std::endl;
-                std::exit(1);
+    static constexpr bool has(unsigned feature) { return (FEATURES & feature) != 0; }
+
+    // with --groupBy tc every game goes to the map of its own group
+    map_t &target() {
+        if constexpr (!has(GAME_GROUPS)) {
+            return *stats_map;
+        } else {
+            // the games of a file mostly share the time control, so the last map is kept
+            if (!group_map || time_control != group_tc) {
+                group_tc  = time_control;
+                group_map = &group_maps.get(game_group(*group, time_control));
             }
 
-            const auto &fix = it->second;
-            std::string fixed_value =
-                fen + " " + std::to_string(fix.first) + " " + std::to_string(fix.second);
-            return fixed_value;
+            return *group_map;
+        }
+    }
+
+    // the packed exit has the counters of the book, the board only needs the position
+    bool set_tree_board(std::string_view fen_view) {
+        try {
+            board.setFen(fen_view);
+        } catch (const std::exception &) {
+            return false;
+        }
+
+        // one king each, the side not to move not in check, and at most a double check
+        const auto stm = board.sideToMove();
+
+        if (board.pieces(PieceType::KING, Color::WHITE).count() != 1 ||
+            board.pieces(PieceType::KING, Color::BLACK).count() != 1) {
+            return false;
         }
 
-        return value_str;
+        return !board.isAttacked(board.kingSq(~stm), stm) &&
+               attacks::attackers(board, ~stm, board.kingSq(stm)).count() <= 2;
     }
-    Result result = Result::UNKNOWN;
-    std::string fen;
-    bool valid_game = true;
-    const CLIOptions &options;
+
+    // the FEN of a new node is only packed on its first visit
+    void add_tree_node(const std::optional<PositionKey> &key) {
+        tree_map.lazy_emplace_l(
+            board.hash(),
+            [&](tree_map_t::value_type &v) {
+                count(v.second);
+                v.second.ply = std::min(v.second.ply, tree_ply);
+            },
+            [&](const tree_map_t::constructor &ctor) {
+                TreeNode node;
+                node.key = key ? *key
+                               : PositionKey::from_fen(board.getFen(false)).value_or(PositionKey());
+                node.ply = tree_ply;
+                count(node);
+                ctor(board.hash(), node);
+            });
+    }
+
+    void count(TreeNode &node) const {
+        if (result == Result::WIN) {
+            node.wins++;
+        } else if (result == Result::DRAW) {
+            node.draws++;
+        } else if (result == Result::LOSS) {
+            node.losses++;
+        }
+    }
+
+    PositionKey fixFen(std::string_view fen_view) {
+        if constexpr (!has(FIX_FENS)) return pack_fen(fen_view);
+
+        bool missing   = false;
+        const auto key = normalize_fen(fen_view, options.fixfens, missing);
+
+        if (missing) {
+            std::cerr << "Could not find FEN " << strip_reset_counters(fen_view)
+                      << " in fixFENsource." << std::endl;
+            std::exit(1);
+        }
+
+        return *key;
+    }
+};
+
+template <unsigned FEATURES>
+std::unique_ptr<Analyzer> create_analyzer(const CLIOptions &options) {
+    return std::make_unique<FeatureAnalyzer<FEATURES>>(options);
+}
+
+template <unsigned... FEATURES>
+std::unique_ptr<Analyzer> create_analyzer(unsigned features, const CLIOptions &options,
+                                          std::integer_sequence<unsigned, FEATURES...>) {
+    using factory = std::unique_ptr<Analyzer> (*)(const CLIOptions &);
+
+    static constexpr factory factories[] = {&create_analyzer<FEATURES>...};
+
+    return factories[features](options);
+}
+
+std::unique_ptr<Analyzer> Analyzer::create(const CLIOptions &options) {
+    unsigned features = 0;
+
+    if (!options.fixfens.empty()) features |= FIX_FENS;
+    if (!options.filter.empty()) features |= FILTER;
+    if (options.tree_depth) features |= TREE;
+    if (groups_per_game(options.group_by)) features |= GAME_GROUPS;
+
+    return create_analyzer(features, options,
+                           std::make_integer_sequence<unsigned, FEATURE_SETS>());
+}
+
+/// @brief The Analyzers of a thread which are not in use, a file takes one and gives it back
+/// once it is done. A worker thus creates one Analyzer, a parser of the pipeline one for each
+/// file it has open at the same time.
+class AnalyzerPool {
+   public:
+    std::unique_ptr<Analyzer> acquire(const CLIOptions &options, map_t &target,
+                                      const std::string *group) {
+        std::unique_ptr<Analyzer> analyzer;
+
+        if (free.empty()) {
+            analyzer = Analyzer::create(options);
+        } else {
+            analyzer = std::move(free.back());
+            free.pop_back();
+        }
+
+        analyzer->start_file(target, group);
+        return analyzer;
+    }
+
+    void release(std::unique_ptr<Analyzer> analyzer) { free.push_back(std::move(analyzer)); }
+
+   private:
+    std::vector<std::unique_ptr<Analyzer>> free;
 };
 
-[[nodiscard]] map_meta get_metadata(const std::vector<std::string> &file_list,
-                                    bool allow_duplicates) {
-    map_meta meta_map;
+AnalyzerPool &thread_analyzers() {
+    thread_local AnalyzerPool pool;
+    return pool;
+}
+
+[[nodiscard]] map_meta get_metadata(const std::vector<TestFile> &tests,
+                                    const CLIOptions &options) {
     std::unordered_map<std::string, std::string> test_map;  // map to check for duplicate tests
     std::set<std::string> test_warned;
-    for (const auto &pathname : file_list) {
-        fs::path path(pathname);
-        std::string filename      = path.filename().string();
-        std::string test_id       = filename.substr(0, filename.find_first_of("-."));
-        std::string test_filename = (path.parent_path() / test_id).string();
-
-        if (test_map.find(test_id) == test_map.end()) {
-            test_map[test_id] = test_filename;
-        } else if (test_map[test_id] != test_filename) {
-            if (test_warned.find(test_filename) == test_warned.end()) {
-                std::cout << (allow_duplicates ? "Warning" : "Error")
-                          << ": Detected a duplicate of test " << test_id << " in directory "
-                          << path.parent_path().string() << std::endl;
-                test_warned.insert(test_filename);
-
-                if (!allow_duplicates) {
+    std::vector<std::string> test_paths;
+
+    for (const auto &test : tests) {
+        if (test_map.find(test.id) == test_map.end()) {
+            test_map[test.id] = test.path;
+            test_paths.push_back(test.path);
+        } else if (test_map[test.id] != test.path) {
+            if (test_warned.find(test.path) == test_warned.end()) {
+                std::cout << (options.allow_duplicates ? "Warning" : "Error")
+                          << ": Detected a duplicate of test " << test.id << " in directory "
+                          << fs::path(test.path).parent_path().string() << std::endl;
+                test_warned.insert(test.path);
+                test_paths.push_back(test.path);
+
+                if (!options.allow_duplicates) {
                     std::cout << "Use --allowDuplicates to continue nonetheless." << std::endl;
                     std::exit(1);
                 }
             }
         }
+    }
 
-        // load the JSON data from disk, only once for each test
-        if (meta_map.find(test_filename) == meta_map.end()) {
-            std::ifstream json_file(test_filename + ".json");
-
-            if (!json_file.is_open()) continue;
-
-            json metadata = json::parse(json_file);
+    // load the JSON data from disk, only once for each test
+    return load_metadata(test_paths, options.meta_index, options.concurrency);
+}
 
-            meta_map[test_filename] = metadata.get<TestMetaData>();
-        }
-    }
-    return meta_map;
+/// @brief Removes the files for which pred(test) is true.
+/// @param file_list
+/// @param pred
+template <typename PRED>
+void remove_files(std::vector<ScannedFile> &file_list, PRED pred) {
+    file_list.erase(std::remove_if(file_list.begin(), file_list.end(),
+                                   [&](const ScannedFile &file) { return pred(file.test); }),
+                    file_list.end());
 }
 
-void filter_files_book(std::vector<std::string> &file_list, const map_meta &meta_map,
+void filter_files_book(std::vector<ScannedFile> &file_list, const map_meta &meta_map,
                        const std::regex &regex_book, bool invert) {
-    const auto pred = [&regex_book, invert, &meta_map](const std::string &pathname) {
-        fs::path path(pathname);
-        std::string filename      = path.filename().string();
-        std::string test_id       = filename.substr(0, filename.find_first_of("-."));
-        std::string test_filename = (path.parent_path() / test_id).string();
-      
+    const auto pred = [&regex_book, invert, &meta_map](const TestFile &test) {
+        const auto &test_filename = test.path;
+
         // check if metadata and "book" entry exist
         if (meta_map.find(test_filename) != meta_map.end() &&
             meta_map.at(test_filename).book.has_value()) {
@@ -211,15 +626,12 @@ void filter_files_book(std::vector<std::string> &file_list, const map_meta &meta
         return true;
     };
 
-    file_list.erase(std::remove_if(file_list.begin(), file_list.end(), pred), file_list.end());
+    remove_files(file_list, pred);
 }
 
-void filter_files_sprt(std::vector<std::string> &file_list, const map_meta &meta_map) {
-    const auto pred = [&meta_map](const std::string &pathname) {
-        fs::path path(pathname);
-        std::string filename      = path.filename().string();
-        std::string test_id       = filename.substr(0, filename.find_first_of("-."));
-        std::string test_filename = (path.parent_path() / test_id).string();
+void filter_files_sprt(std::vector<ScannedFile> &file_list, const map_meta &meta_map) {
+    const auto pred = [&meta_map](const TestFile &test) {
+        const auto &test_filename = test.path;
 
         // check if metadata and "sprt" entry exist
         if (meta_map.find(test_filename) != meta_map.end() &&
@@ -231,195 +643,1023 @@ void filter_files_sprt(std::vector<std::string> &file_list, const map_meta &meta
         return true;
     };
 
-    file_list.erase(std::remove_if(file_list.begin(), file_list.end(), pred), file_list.end());
+    remove_files(file_list, pred);
 }
 
-void analyze_pgn(const std::vector<std::string> &files, const CLIOptions &options) {
-    for (const auto &file : files) {
-        const auto pgn_iterator = [&](std::istream &iss) {
-            auto vis = std::make_unique<Analyzer>(options);
+/// @brief Keeps about the given share of the files, by a hash of their path, so that the same
+/// files are sampled by every run.
+/// @param file_list
+/// @param rate
+void filter_files_sample(std::vector<ScannedFile> &file_list, double rate) {
+    if (rate >= 1) return;
+
+    // compared in the top 32 bits, the product with 2^64 would not fit for a rate of 1
+    const auto limit = static_cast<std::uint64_t>(rate * 4294967296.0);
+
+    file_list.erase(std::remove_if(file_list.begin(), file_list.end(),
+                                   [limit](const ScannedFile &file) {
+                                       return (stable_hash(file.path) >> 32) >= limit;
+                                   }),
+                    file_list.end());
+}
 
-            pgn::StreamParser parser(iss);
+void filter_files_shard(std::vector<ScannedFile> &file_list, int shard_index,
+                        int shard_count) {
+    const auto pred = [shard_index, shard_count](const TestFile &test) {
+        return stable_hash(test.id) % shard_count != std::uint64_t(shard_index);
+    };
 
-            try {
-                parser.readGames(*vis);
-            } catch (const std::exception &e) {
-                std::cout << "Error when parsing: " << file << std::endl;
-                std::cerr << e.what() << '\n';
-            }
-        };
+    remove_files(file_list, pred);
+}
 
-        if (file.size() >= 3 && file.substr(file.size() - 3) == ".gz") {
-            igzstream input(file.c_str());
-            pgn_iterator(input);
-        } else {
-            std::ifstream pgn_stream(file);
-            pgn_iterator(pgn_stream);
-            pgn_stream.close();
-        }
-    }
+/// @brief The file of a job in its spans of --trace, with the byte range of a split file, so
+/// that a straggler among the ranges stands out.
+/// @param job
+/// @return
+std::string trace_detail(const PgnJob &job) {
+    const bool to_end = job.end == std::numeric_limits<std::size_t>::max();
+
+    if (job.begin == 0 && to_end) return job.file;
+
+    return job.file + " [" + std::to_string(job.begin) + ", " +
+           (to_end ? std::string("end") : std::to_string(job.end)) + ")";
 }
 
-[[nodiscard]] map_fens get_fixfen(std::string file) {
-    map_fens fixfen_map;
-    if (file.empty()) {
-        return fixfen_map;
-    }
+/// @brief Adds the games of one pgn file, or of its byte range, to stats_map.
+/// @param job
+/// @param options
+/// @param stats_map
+/// @param games number of games added
+/// @param progress updated after every block of the file
+/// @return false if the file could not be parsed completely
+bool analyze_file(const PgnJob &job, const CLIOptions &options, map_t &stats_map,
+                  std::size_t &games, JobProgress &progress) {
+    const auto &file = job.file;
+
+    const auto detail = Trace::enabled() ? trace_detail(job) : std::string();
+    const TraceSpan span("file", detail);
+
+    auto &analyzers = thread_analyzers();
+    auto vis        = analyzers.acquire(options, stats_map, game_groups(options, file));
+    bool valid      = true;
+
+    const auto report_error = [&](const std::exception &e) {
+        std::cout << "Error when parsing: " << file << std::endl;
+        std::cerr << e.what() << '\n';
+        valid = false;
+    };
 
-    const auto fen_iterator = [&](std::istream &iss) {
-        std::string line;
-        while (std::getline(iss, line)) {
-            std::istringstream iss(line);
-            std::string f1, f2, f3, ep;
-            int halfmove, fullmove = 0;
+    auto &stats = thread_stats();
+    std::chrono::duration<double> parse_time{0};
+    std::uint64_t inflated = 0;
+    Stopwatch watch;
 
-            iss >> f1 >> f2 >> f3 >> ep >> halfmove >> fullmove;
+    // the Analyzer skips the move sections, or reads only their first moves with --treeDepth
+    if (file.size() >= 3 && file.substr(file.size() - 3) == ".gz") {
+        // the 5 MB of buffers and the zlib state are allocated once per thread
+        thread_local GzFileReader reader;
+
+        {
+            const TraceSpan open_span("open", detail);
+            reader.open(file);
+        }
+
+        PgnHeaderScanner scanner(*vis, options.tree_depth > 0);
 
-            if (!fullmove) continue;
+        try {
+            std::size_t keep = 0;
 
-            auto key         = f1 + ' ' + f2 + ' ' + f3 + ' ' + ep;
-            auto fixfen_data = std::pair<int, int>(halfmove, fullmove);
+            while (!reader.eof()) {
+                std::string_view chunk;
 
-            if (fixfen_map.find(key) != fixfen_map.end()) {
-                // for duplicate FENs, prefer the one with lower full move counter
-                if (fullmove < fixfen_map[key].second) {
-                    fixfen_map[key] = fixfen_data;
+                {
+                    const TraceSpan inflate_span("inflate", detail);
+                    chunk = reader.next(keep);
                 }
-            } else {
-                fixfen_map[key] = fixfen_data;
+
+                const TraceSpan parse_span("parse", detail);
+                const auto t0 = std::chrono::steady_clock::now();
+
+                keep = chunk.size() - scanner.feed(chunk, reader.eof());
+
+                parse_time += std::chrono::steady_clock::now() - t0;
+                inflated += chunk.size() - keep;
+
+                progress.update(reader.compressed_bytes(), vis->games());
             }
+        } catch (const std::exception &e) {
+            report_error(e);
         }
-    };
 
-    if (file.size() >= 3 && file.substr(file.size() - 3) == ".gz") {
-        igzstream input(file.c_str());
-        fen_iterator(input);
+        // next() reads and inflates, the time it spent in reading is known
+        stats.read += reader.read_seconds();
+        stats.inflate += watch.lap() - parse_time.count() - reader.read_seconds();
+        stats.compressed_bytes += reader.compressed_bytes();
+        stats.decompressed_bytes += inflated;
+        stats.parsed_bytes += inflated;
+
+        reader.close();
+    } else if (MappedFile mapped(file); mapped.is_open()) {
+        // uncompressed files are mapped, a range starts and ends at the next game boundary
+        auto view = mapped.view();
+
+        if (job.begin > 0 || job.end < view.size()) {
+            const auto begin = job.begin == 0 ? 0 : find_next_game(view, job.begin);
+            const auto end   = job.end >= view.size() ? view.size() : find_next_game(view, job.end);
+
+            view = begin < end ? view.substr(begin, end - begin) : std::string_view();
+        }
+
+        // the pages are read while scanning, so this includes reading the file
+        PgnHeaderScanner scanner(*vis, options.tree_depth > 0);
+
+        // fed in blocks, so that the progress moves on within a large file
+        std::size_t pos   = 0;
+        std::size_t block = MAPPED_BLOCK_SIZE;
+
+        while (true) {
+            const auto data = view.substr(pos, block);
+            const bool last = pos + data.size() == view.size();
+            const TraceSpan parse_span("parse", detail);
+            const auto used = scanner.feed(data, last);
+
+            if (last) break;
+
+            // the block ends inside a game which is larger than the block itself
+            if (used == 0) block *= 2;
+
+            pos += used;
+            progress.update(pos, vis->games());
+        }
+
+        parse_time = std::chrono::duration<double>(watch.lap());
+        stats.parsed_bytes += view.size();
     } else {
-        std::ifstream input(file);
-        fen_iterator(input);
+        std::ifstream pgn_stream(file);
+
+        pgn::StreamParser parser(pgn_stream);
+
+        // the StreamParser clears a header value right after passing it on
+        vis->copy_header_values();
+
+        try {
+            const TraceSpan parse_span("parse", detail);
+            parser.readGames(*vis);
+        } catch (const std::exception &e) {
+            report_error(e);
+        }
+
+        parse_time = std::chrono::duration<double>(watch.lap());
     }
 
-    return fixfen_map;
-}
+    stats.parse += parse_time.count();
+    stats.files++;
 
-void process(const CLIOptions &options) {
-    int target_chunks = 4 * options.concurrency;
+    games = vis->games();
 
-    auto files_pgn = get_files(options.dir, true);
+    analyzers.release(std::move(vis));
 
-    const auto meta_map = get_metadata(files_pgn, options.allow_duplicates);
+    return valid;
+}
 
-    if (!options.match_book.empty()) {
-        std::regex regex(options.match_book);
-        filter_files_book(files_pgn, meta_map, regex, options.matchBookInverted);
-    }
+void analyze_job(const PgnJob &job, const CLIOptions &options, const ResultCache *cache,
+                 ProgressReporter &reporter) {
+    map_t &target     = file_target(options, job.file);
+    std::size_t games = 0;
 
-    if (options.only_sprt) {
-        filter_files_sprt(files_pgn, meta_map);
+    JobProgress progress(&reporter, job.size);
+
+    if (!cache && !checkpoints) {
+        analyze_file(job, options, target, games, progress);
+        total_games += games;
+        return;
     }
 
-    auto files_chunked = split_chunks(files_pgn, target_chunks);
+    // collect the file separately, only its own contribution goes into the cache, and a
+    // checkpoint takes it as a whole
+    map_t file_map;
 
-    // Mutex for progress success
-    std::mutex progress_mutex;
+    // taken before the file is read, so that a file which changes meanwhile is not cached with
+    // its new size and time
+    const auto info = cache ? file_info(job.file) : FileInfo();
 
-    // Create a thread pool
-    ThreadPool pool(options.concurrency);
+    if (cache && cache->load(job.file, info, checkpoints ? file_map : target, games)) {
+        progress.update(0, games);
+        total_cached++;
+        complete_file(job.file, games, [&]() { merge_into(target, file_map); });
+        total_games += games;
+        return;
+    }
 
-    // Print progress
-    std::cout << "\rProgress: " << total_chunks << "/" << files_chunked.size() << std::flush;
+    if (analyze_file(job, options, file_map, games, progress) && cache) {
+        cache->store(job.file, info, file_map, games);
+    }
 
-    for (const auto &files : files_chunked) {
-        pool.enqueue([&files, &files_chunked, &progress_mutex, &options]() {
-            analyze_pgn(files, options);
+    complete_file(job.file, games, [&]() { merge_into(target, file_map); });
+    total_games += games;
+}
 
-            total_chunks++;
+/// @brief Receives one file from the pipeline, with the same bookkeeping as analyze_job.
+class AnalyzerSink : public FileSink {
+   public:
+    AnalyzerSink(const std::string &file, const CLIOptions &options, const ResultCache *cache,
+                 const FileInfo &info, ProgressReporter &progress)
+        : file(file),
+          options(options),
+          cache(cache),
+          info(info),
+          progress(progress),
+          target(file_target(options, file)),
+          file_map(cache || checkpoints ? std::make_unique<map_t>() : nullptr),
+          analyzer(thread_analyzers().acquire(options, file_map ? *file_map : target,
+                                              game_groups(options, file))),
+          scanner(*analyzer, options.tree_depth > 0) {}
+
+    // the sink is destroyed by the parser which created it
+    ~AnalyzerSink() override { thread_analyzers().release(std::move(analyzer)); }
+
+    // the bytes are counted by the readers of the pipeline, the games here
+    std::size_t feed(std::string_view data, bool eof) override {
+        const auto games    = analyzer->games();
+        const auto consumed = scanner.feed(data, eof);
+
+        progress.add_games(analyzer->games() - games);
+
+        return consumed;
+    }
 
-            // Limit the scope of the lock
-            {
-                const std::lock_guard<std::mutex> lock(progress_mutex);
+    void finish(const std::string &error) override {
+        if (!error.empty()) {
+            std::cout << "Error when parsing: " << file << std::endl;
+            std::cerr << error << '\n';
+        }
 
-                // Print progress
-                std::cout << "\rProgress: " << total_chunks << "/" << files_chunked.size()
-                          << std::flush;
+        if (file_map) {
+            if (cache && error.empty()) {
+                cache->store(file, info, *file_map, analyzer->games());
             }
-        });
-    }
 
-    // Wait for all threads to finish
-    pool.wait();
-}
+            complete_file(file, analyzer->games(), [&]() { merge_into(target, *file_map); });
+        }
+
+        total_games += analyzer->games();
 
-void write_results() {
-    std::ofstream out("results.csv");
+        progress.job_done();
+        bound_memory(options);
+    }
 
-    out << "FEN, Wins, Draws, Losses\n";
+   private:
+    std::string file;
+    const CLIOptions &options;
+    const ResultCache *cache;
+    FileInfo info;
+    ProgressReporter &progress;
 
-    // Sort the map by the number of wins, draws, and losses
-    std::vector<std::pair<std::string, Statistics>> sorted_map(occurance_map.begin(),
-                                                               occurance_map.end());
+    map_t &target;
+    std::unique_ptr<map_t> file_map;
 
-    std::sort(sorted_map.begin(), sorted_map.end(),
-              [](const auto &a, const auto &b) { return a.second < b.second; });
+    std::unique_ptr<Analyzer> analyzer;
+    PgnHeaderScanner scanner;
+};
 
-    std::size_t wins   = 0;
-    std::size_t draws  = 0;
-    std::size_t losses = 0;
+/// @brief Records the entries and the approximate memory of maps which are alive at the same
+/// time, the largest values seen are kept.
+/// @param maps
+void record_map_size(const std::vector<map_t *> &maps) {
+    std::size_t entries = 0;
+    std::size_t bytes   = 0;
 
-    for (const auto &[fen, stats] : sorted_map) {
-        wins += stats.wins;
-        draws += stats.draws;
-        losses += stats.losses;
+    for (const auto *stats_map : maps) {
+        entries += stats_map->size();
 
-        out << fen << ", " << stats.wins << ", " << stats.draws << ", " << stats.losses << "\n";
+        // a flat map holds one slot and one control byte per bucket
+        bytes += stats_map->capacity() * (sizeof(map_t::value_type) + 1);
     }
 
-    std::cout << "Analyzed " << total_games << " games in total (W/D/L = " << wins << "/" << draws
-              << "/" << losses << ")" << std::endl;
-    std::cout << "Wrote results to results.csv" << std::endl;
+    auto &info = run_stats.info()["map"];
+
+    if (info.is_null()) info = json::object();
 
-    out.close();
+    info["peak_entries"] = std::max(info.value("peak_entries", std::size_t(0)), entries);
+    info["peak_bytes"]   = std::max(info.value("peak_bytes", std::size_t(0)), bytes);
 }
 
-/// @brief ./analysis [--dir path] [--concurrency n] [--matchBook book]
-/// [--allowDuplicates] [--SPRTonly] [--matchBookInvert] [--fixFENsource file]
-/// @param argc
-/// @param argv
+/// @brief The maps which are written, each with its group, the group is empty without
+/// --groupBy.
+/// @param options
 /// @return
-int main(int argc, char const *argv[]) {
-    CommandLine cmd(argc, argv);
+[[nodiscard]] std::vector<std::pair<std::string, map_t *>> result_maps(
+    const CLIOptions &options) {
+    if (options.group_by.empty()) return {{"", &occurance_map}};
 
-    CLIOptions options;
+    return group_maps.all();
+}
 
-    if (cmd.has("--dir")) {
-        options.dir = cmd.get("--dir");
-        std::cout << "Looking (recursively) for pgn files in " << options.dir << std::endl;
+/// @brief Analyses the pgn files which pass the filters into the result maps.
+/// @param options
+/// @param files_pgn
+/// @param watch
+void analyse_files(const CLIOptions &options, std::vector<ScannedFile> files_pgn,
+                   Stopwatch &watch) {
+    // all files of a test, and all copies of it, end up in the same shard
+    if (options.shard_count > 1) {
+        filter_files_shard(files_pgn, options.shard_index, options.shard_count);
     }
 
-    if (cmd.has("--concurrency")) {
-        options.concurrency = std::stoi(cmd.get("--concurrency"));
-    } else {
-        options.concurrency = std::max(1, int(std::thread::hardware_concurrency()));
+    run_stats.stage("filter", watch.lap());
+
+    // the test of each file was derived by the scan, the filters only compare these
+    std::vector<TestFile> tests;
+    tests.reserve(files_pgn.size());
+
+    for (const auto &file : files_pgn) {
+        tests.push_back(file.test);
     }
-    std::cout << "Files will be processed with concurrency " << options.concurrency << std::endl;
 
-    if (cmd.has("--matchBook")) {
-        options.match_book = cmd.get("--matchBook");
+    const auto meta_map = get_metadata(tests, options);
 
-        if (options.match_book.empty()) {
-            std::cerr << "Error: --matchBook cannot be empty" << std::endl;
-            return 1;
-        }
+    run_stats.stage("metadata", watch.lap());
 
-        if (cmd.has("--matchBookInvert")) {
-            options.matchBookInverted = true;
-        }
-        std::cout << "Filtering pgn files " << (options.matchBookInverted ? "not " : "")
-                  << "matching the book name " << options.match_book << std::endl;
+    if (!options.match_book.empty()) {
+        std::regex regex(options.match_book);
+        filter_files_book(files_pgn, meta_map, regex, options.matchBookInverted);
     }
 
-    if (cmd.has("--allowDuplicates")) {
-        options.allow_duplicates = true;
+    if (options.only_sprt) {
+        filter_files_sprt(files_pgn, meta_map);
+    }
+
+    if (approx_counter) {
+        std::uint64_t bytes = 0, sampled_bytes = 0;
+
+        for (const auto &file : files_pgn) bytes += file.info.size;
+
+        const auto files = files_pgn.size();
+        filter_files_sample(files_pgn, options.approx_rate);
+
+        for (const auto &file : files_pgn) sampled_bytes += file.info.size;
+
+        // the counts are scaled by the share of the files, the bytes of compressed and plain
+        // files are not comparable
+        approx_sample = {{"rate", options.approx_rate},
+                         {"files", files},
+                         {"files_sampled", files_pgn.size()},
+                         {"bytes", bytes},
+                         {"bytes_sampled", sampled_bytes}};
+
+        approx_scale = files_pgn.empty() ? 1.0 : double(files) / files_pgn.size();
+
+        std::cout << "Sampled " << files_pgn.size() << " of " << files << " files" << std::endl;
+    }
+
+    // the files of the checkpoint which was resumed are in the maps already
+    if (checkpoints) {
+        const auto files = files_pgn.size();
+
+        files_pgn.erase(std::remove_if(files_pgn.begin(), files_pgn.end(),
+                                       [](const ScannedFile &file) {
+                                           return checkpoints->covers(file.path);
+                                       }),
+                        files_pgn.end());
+
+        if (files_pgn.size() < files) {
+            std::cout << "Skipping " << files - files_pgn.size()
+                      << " files which were analysed before the checkpoint" << std::endl;
+        }
+    }
+
+    // cache entries and checkpoints cover whole files, so files are only split without them
+    const bool split = options.cache_dir.empty() && !options.pipeline && !checkpoints;
+    const auto jobs  = plan_jobs(files_pgn, options.concurrency, split);
+
+    if (!options.group_by.empty()) {
+        for (const auto &file : files_pgn) {
+            group_maps.assign(file.path, test_group(options.group_by, file.test, meta_map));
+        }
+    }
+
+    run_stats.stage("filter", watch.lap());
+    run_stats.info()["files"]["analysed"] = files_pgn.size();
+    run_stats.info()["jobs"]              = jobs.size();
+
+    std::uint64_t total_bytes = 0;
+
+    for (const auto &job : jobs) total_bytes += job.size;
+
+    std::unique_ptr<ResultCache> cache;
+
+    if (!options.cache_dir.empty()) {
+        cache = std::make_unique<ResultCache>(options.cache_dir, options);
+    }
+
+    ProgressReporter progress(total_bytes, jobs.size());
+
+    if (options.pipeline) {
+        std::vector<std::string> files;
+        std::unordered_map<std::string, FileInfo> file_infos;
+
+        // cached files never enter the pipeline, their entries are loaded on the pool
+        if (cache) {
+            std::mutex files_mutex;
+            std::vector<std::size_t> missed;
+            std::vector<FileInfo> infos(jobs.size());
+            std::vector<WorkStealingScheduler::Job> tasks;
+
+            for (std::size_t i = 0; i < jobs.size(); i++) {
+                tasks.push_back([&, i](std::size_t) {
+                    const auto &job   = jobs[i];
+                    map_t &target     = file_target(options, job.file);
+                    std::size_t games = 0;
+                    map_t file_map;
+
+                    // taken before the pipeline reads a missed file
+                    infos[i] = file_info(job.file);
+
+                    if (cache->load(job.file, infos[i], checkpoints ? file_map : target, games)) {
+                        complete_file(job.file, games, [&]() { merge_into(target, file_map); });
+                        total_cached++;
+                        total_games += games;
+                        progress.add_bytes(job.size);
+                        progress.add_games(games);
+                        progress.job_done();
+                        bound_memory(options);
+                    } else {
+                        const std::lock_guard<std::mutex> lock(files_mutex);
+                        missed.push_back(i);
+                    }
+                });
+            }
+
+            WorkStealingScheduler(options.concurrency).run(std::move(tasks));
+
+            // keep the largest files first, as the jobs are
+            std::sort(missed.begin(), missed.end());
+
+            for (const auto i : missed) {
+                files.push_back(jobs[i].file);
+                file_infos.emplace(jobs[i].file, infos[i]);
+            }
+        } else {
+            for (const auto &job : jobs) files.push_back(job.file);
+        }
+
+        Pipeline pipeline(options.readers, options.inflaters, options.parsers);
+        pipeline.count_read_bytes(&progress.bytes());
+
+        pipeline.run(files, [&](const std::string &file) {
+            const auto it   = file_infos.find(file);
+            const auto info = it == file_infos.end() ? FileInfo() : it->second;
+
+            return std::make_unique<AnalyzerSink>(file, options, cache.get(), info, progress);
+        });
+    } else {
+        std::vector<WorkStealingScheduler::Job> tasks;
+
+        for (const auto &job : jobs) {
+            tasks.push_back([&job, &options, &cache, &progress](std::size_t) {
+                analyze_job(job, options, cache.get(), progress);
+                progress.job_done();
+                bound_memory(options);
+            });
+        }
+
+        WorkStealingScheduler scheduler(options.concurrency);
+
+        if (!node_maps.empty()) scheduler.on_start(pin_worker);
+
+        // Wait for all threads to finish
+        scheduler.run(std::move(tasks));
+    }
+
+    progress.stop();
+
+    run_stats.stage("analysis", watch.lap());
+
+    if (!node_maps.empty()) {
+        std::vector<map_t *> maps;
+
+        for (const auto &stats_map : node_maps) maps.push_back(stats_map.get());
+
+        record_map_size(maps);
+
+        // the node maps are left empty for the next batch of --serve
+        merge_parallel(occurance_map, maps, options.concurrency);
+
+        run_stats.stage("merge", watch.lap());
+    }
+
+    if (options.local_maps) {
+        record_map_size(worker_maps.all());
+
+        merge_parallel(occurance_map, worker_maps.all(),
+                       options.pipeline ? options.parsers : options.concurrency);
+        worker_maps.clear();
+
+        run_stats.stage("merge", watch.lap());
+    }
+
+    std::vector<map_t *> maps;
+
+    for (const auto &[group, stats_map] : result_maps(options)) {
+        maps.push_back(stats_map);
+    }
+
+    record_map_size(maps);
+    run_stats.info()["files"]["cached"] = total_cached.load();
+
+    if (cache) {
+        std::cout << "\nReused cached results for " << total_cached << "/" << files_pgn.size()
+                  << " files" << std::flush;
+    }
+}
+
+/// @brief Analyses all pgn files in --dir.
+/// @param options
+/// @return every file which was found, including the ones the filters dropped
+std::vector<std::string> process(const CLIOptions &options) {
+    Stopwatch watch;
+
+    auto scan = scan_files(options.dir, options.manifest_file, options.concurrency);
+
+    run_stats.stage("scan", watch.lap());
+    run_stats.info()["files"]["found"]       = scan.files.size();
+    run_stats.info()["files"]["listed_dirs"] = scan.listed_dirs;
+    run_stats.info()["files"]["reused_dirs"] = scan.reused_dirs;
+
+    if (!options.manifest_file.empty()) {
+        std::cout << "Listed " << scan.listed_dirs << " directories, " << scan.reused_dirs
+                  << " were unchanged" << std::endl;
+    }
+
+    std::vector<std::string> files;
+
+    for (const auto &file : scan.files) files.push_back(file.path);
+
+    analyse_files(options, std::move(scan.files), watch);
+
+    return files;
+}
+
+/// @brief Name of an output file, a group and a shard add their name, e.g. results.csv,
+/// results-2-of-8.csv or results-UHO_Lichess_4852_v1.epd-2-of-8.csv.
+/// @param options
+/// @param group empty without --groupBy
+/// @param extension
+/// @param base prefix of the name, e.g. "filtered"
+/// @return
+[[nodiscard]] std::string results_file(const CLIOptions &options, const std::string &group,
+                                       const std::string &extension,
+                                       const std::string &base = "results") {
+    std::string name = base;
+
+    if (!group.empty()) name += "-" + group;
+
+    if (options.shard_count > 1) {
+        name += "-" + std::to_string(options.shard_index) + "-of-" +
+                std::to_string(options.shard_count);
+    }
+
+    return name + extension;
+}
+
+/// @brief Merges the move counter variants of the written positions, writes their histograms
+/// and, with a draw rate limit, the positions within the limits.
+/// @param options
+/// @param group empty without --groupBy
+/// @param rows as written to the CSV file
+void post_process(const CLIOptions &options, const std::string &group,
+                  const std::vector<ResultRow> &rows) {
+    const auto merged = merge_counters(rows, options.concurrency);
+
+    if (merged.rows.size() != rows.size()) {
+        std::cout << "Merged the move counter variants of " << rows.size() << " positions into "
+                  << merged.rows.size() << std::endl;
+    }
+
+    const auto json_file = results_file(options, group, ".json", "histograms");
+
+    if (!write_histograms(json_file, histograms(merged.rows, options.concurrency))) {
+        std::cerr << "Error: could not write " << json_file << std::endl;
+    } else {
+        std::cout << "Wrote histograms to " << json_file << std::endl;
+    }
+
+    if (!options.draw_rate_min && !options.draw_rate_max) return;
+
+    const auto kept     = filter_exits(merged.rows, options.draw_rate_min, options.draw_rate_max,
+                                       options.draw_rate_games);
+    const auto csv_file = results_file(options, group, options.csv_extension, "filtered");
+    const auto epd_file = results_file(options, group, ".epd", "filtered");
+
+    if (!write_csv(csv_file, kept, options.concurrency) || !write_epd(epd_file, kept)) {
+        std::cerr << "Error: could not write " << csv_file << " or " << epd_file << std::endl;
+        return;
+    }
+
+    std::cout << "Wrote " << kept.size() << " filtered positions to " << epd_file << " and "
+              << csv_file << std::endl;
+}
+
+/// @brief Sorts and writes the results of one group.
+/// @param options
+/// @param group empty without --groupBy
+/// @param stats_map
+/// @param games stored in the binary results
+/// @param watch
+/// @return number of positions written
+std::size_t write_group(const CLIOptions &options, const std::string &group,
+                        const map_t &stats_map, std::size_t games, Stopwatch &watch) {
+    // Sort the map by the number of wins, draws, and losses
+    const auto rows =
+        sorted_results(stats_map, options.min_games, options.top_n, options.concurrency);
+
+    run_stats.stage("sort", watch.lap());
+
+    const auto csv_file = results_file(options, group, options.csv_extension);
+    const bool written  = write_csv(csv_file, rows, options.concurrency);
+
+    run_stats.stage("write", watch.lap());
+
+    if (rows.size() != stats_map.size()) {
+        std::cout << "Kept " << rows.size() << " of " << stats_map.size() << " positions"
+                  << std::endl;
+    }
+
+    if (!written) {
+        std::cerr << "Error: could not write " << csv_file << std::endl;
+        return rows.size();
+    }
+
+    std::cout << "Wrote results to " << csv_file << std::endl;
+
+    if (options.post_process) {
+        post_process(options, group, rows);
+
+        run_stats.stage("post_process", watch.lap());
+    }
+
+    // the binary results of the shards are combined with ./analysis merge
+    const auto bin_file = results_file(options, group, ".bin");
+
+    if ((options.binary || options.shard_count > 1) &&
+        write_result_file(bin_file, stats_map, games, options.concurrency)) {
+        std::cout << "Wrote binary results to " << bin_file << std::endl;
+    }
+
+    run_stats.stage("write", watch.lap());
+
+    return rows.size();
+}
+
+/// @brief Merges the runs of --spill, occurance_map is spilled as the last run.
+/// @param options
+/// @param watch
+void write_spilled(const CLIOptions &options, Stopwatch &watch) {
+    spilled_results->spill(occurance_map, options.concurrency);
+
+    run_stats.stage("spill", watch.lap());
+
+    const auto csv_file = results_file(options, "", options.csv_extension);
+    const auto bin_file = options.binary || options.shard_count > 1
+                              ? results_file(options, "", ".bin")
+                              : std::string();
+
+    SpillSummary summary;
+
+    const bool written =
+        spilled_results->write(csv_file, bin_file, total_games, options.min_games, options.top_n,
+                               options.concurrency, summary);
+
+    run_stats.stage("write", watch.lap());
+
+    std::cout << "Analyzed " << total_games << " games in total (W/D/L = " << summary.totals.wins
+              << "/" << summary.totals.draws << "/" << summary.totals.losses << ")" << std::endl;
+
+    std::cout << "Merged " << spilled_results->records() << " records of "
+              << spilled_results->runs() << " runs into " << summary.positions << " positions"
+              << std::endl;
+
+    if (summary.written != summary.positions) {
+        std::cout << "Kept " << summary.written << " of " << summary.positions << " positions"
+                  << std::endl;
+    }
+
+    if (!written) {
+        std::cerr << "Error: could not write " << csv_file << std::endl;
+    } else {
+        std::cout << "Wrote results to " << csv_file << std::endl;
+
+        if (!bin_file.empty()) std::cout << "Wrote binary results to " << bin_file << std::endl;
+    }
+
+    run_stats.info()["games"]["total"]    = total_games.load();
+    run_stats.info()["map"]["positions"]  = summary.positions;
+    run_stats.info()["positions_written"] = summary.written;
+    run_stats.info()["spill"]             = {{"runs", spilled_results->runs()},
+                                             {"records", spilled_results->records()},
+                                             {"seconds", spilled_results->seconds()}};
+}
+
+/// @brief Writes the positions of --treeDepth to tree.csv.
+/// @param options
+/// @param watch
+void write_tree_results(const CLIOptions &options, Stopwatch &watch) {
+    const auto tree_file = results_file(options, "", ".csv", "tree");
+    std::size_t written  = 0;
+
+    if (!write_tree(tree_file, tree_map, options.min_games, options.top_n, options.concurrency,
+                    written)) {
+        std::cerr << "Error: could not write " << tree_file << std::endl;
+        return;
+    }
+
+    std::cout << "Wrote " << written << " of " << tree_map.size() << " positions up to ply "
+              << options.tree_depth << " to " << tree_file << std::endl;
+
+    run_stats.stage("write", watch.lap());
+    run_stats.info()["tree"] = {{"positions", tree_map.size()}, {"written", written}};
+}
+
+/// @brief Moves the estimates of --approx into occurance_map, which is written as usual, and
+/// writes their error bounds to approx.json.
+/// @param options
+void collect_approx(const CLIOptions &options) {
+    const auto totals = approx_counter->totals();
+
+    approx_counter->collect(occurance_map, approx_scale);
+
+    auto bounds      = approx_counter->bounds(approx_scale);
+    bounds["sample"] = approx_sample;
+    bounds["games_sampled"] = {
+        {"wins", totals.wins}, {"draws", totals.draws}, {"losses", totals.losses}};
+
+    const auto file = results_file(options, "", ".json", "approx");
+
+    std::ofstream os(file);
+    os << bounds.dump(4) << std::endl;
+
+    if (!os) std::cerr << "Warning: could not write " << file << std::endl;
+
+    std::cout << "Estimated " << std::llround(totals.total() * approx_scale) << " games from "
+              << totals.total() << " sampled games (W/D/L = " << totals.wins << "/"
+              << totals.draws << "/" << totals.losses << "), about "
+              << std::llround(approx_counter->distinct_positions())
+              << " distinct positions in the sample" << std::endl;
+    std::cout << "Wrote the error bounds of the estimates to " << file << std::endl;
+}
+
+void write_results(const CLIOptions &options) {
+    Stopwatch watch;
+
+    if (spilled_results && spilled_results->runs()) {
+        write_spilled(options, watch);
+        return;
+    }
+
+    if (approx_counter) collect_approx(options);
+
+    const auto maps = result_maps(options);
+
+    Statistics totals;
+    std::size_t positions = 0;
+
+    for (const auto &[group, stats_map] : maps) {
+        for (const auto &[key, stats] : *stats_map) {
+            totals += stats;
+        }
+
+        positions += stats_map->size();
+    }
+
+    // the totals of --approx were printed with the estimates, the map only has the candidates
+    if (!approx_counter) {
+        std::cout << "Analyzed " << total_games << " games in total (W/D/L = " << totals.wins
+                  << "/" << totals.draws << "/" << totals.losses << ")" << std::endl;
+    }
+
+    std::size_t written = 0;
+
+    for (const auto &[group, stats_map] : maps) {
+        if (group.empty()) {
+            written += write_group(options, group, *stats_map, total_games, watch);
+            continue;
+        }
+
+        Statistics group_totals;
+
+        for (const auto &[key, stats] : *stats_map) {
+            group_totals += stats;
+        }
+
+        std::cout << "Group " << group << ": " << group_totals.total()
+                  << " games (W/D/L = " << group_totals.wins << "/" << group_totals.draws << "/"
+                  << group_totals.losses << ")" << std::endl;
+
+        written += write_group(options, group, *stats_map, group_totals.total(), watch);
+    }
+
+    run_stats.info()["games"]["total"]    = total_games.load();
+    run_stats.info()["map"]["positions"]  = positions;
+    run_stats.info()["positions_written"] = written;
+    run_stats.info()["groups"]            = options.group_by.empty() ? std::size_t(0) : maps.size();
+
+    if (options.tree_depth) write_tree_results(options, watch);
+}
+
+/// @brief Keeps occurance_map up to date with the pgn files which appear in --dir and answers
+/// queries on it, see ResultServer, until a client asks for a shutdown.
+/// @param options
+/// @param watcher
+/// @param files the files found by process()
+/// @return false if the socket could not be opened
+bool serve(const CLIOptions &options, DirectoryWatcher &watcher,
+           const std::vector<std::string> &files) {
+    ResultServer server(options.serve_socket, occurance_map, options);
+
+    if (!server.is_open()) return false;
+
+    std::set<std::string> known(files.begin(), files.end());
+
+    // the size of a new file at the last scan, a file is ingested once it stopped growing
+    std::unordered_map<std::string, std::uintmax_t> pending;
+
+    // the filters need the .json of a test, which may be written after its pgn files
+    const bool needs_metadata = !options.match_book.empty() || options.only_sprt;
+
+    server.set_status(known.size(), total_games);
+
+    std::cout << "Serving queries on " << options.serve_socket
+              << (watcher.is_watching() ? ", watching " : ", polling ") << options.dir
+              << " for new files" << std::endl;
+
+    while (!server.stopped()) {
+        std::set<std::string> dirs;
+
+        if (!watcher.wait(SERVE_INTERVAL, dirs) && pending.empty()) continue;
+
+        // only polled, the manifest saves the listing of every directory which did not change
+        std::map<std::string, ScannedFile> candidates;
+
+        if (!watcher.is_watching()) {
+            for (auto &file :
+                 scan_files(options.dir, options.manifest_file, options.concurrency).files) {
+                candidates[file.path] = std::move(file);
+            }
+        }
+
+        // a growing file does not change its directory, its size is only current in a new
+        // listing
+        for (const auto &[path, size] : pending) dirs.insert(fs::path(path).parent_path().string());
+
+        for (const auto &dir : dirs) {
+            for (auto &file : list_files(dir)) candidates[file.path] = std::move(file);
+        }
+
+        std::vector<ScannedFile> batch;
+
+        for (auto &[path, file] : candidates) {
+            if (known.count(file.path) || !file.info.valid) continue;
+
+            const auto size   = file.info.size;
+            const auto it     = pending.find(file.path);
+            const bool stable = it != pending.end() && it->second == size;
+
+            if (stable && (!needs_metadata || fs::exists(file.test.path + ".json"))) {
+                pending.erase(it);
+                batch.push_back(std::move(file));
+            } else {
+                pending[file.path] = size;
+            }
+        }
+
+        if (batch.empty()) continue;
+
+        std::cout << "Ingesting " << batch.size() << " new files" << std::endl;
+
+        Stopwatch watch;
+        analyse_files(options, batch, watch);
+
+        for (const auto &file : batch) known.insert(file.path);
+
+        server.set_status(known.size(), total_games);
+
+        std::cout << "\nServing " << total_games << " games of " << known.size() << " files"
+                  << std::endl;
+    }
+
+    return true;
+}
+
+/// @brief ./analysis merge [--csv file] [--concurrency n] output.bin input.bin [input.bin ...]
+/// @param argc
+/// @param argv
+/// @return
+int merge_main(int argc, char const *argv[]) {
+    std::string csv;
+    int concurrency = std::max(1, int(std::thread::hardware_concurrency()));
+    std::vector<std::string> files;
+
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "--csv" && i + 1 < argc) {
+            csv = argv[++i];
+        } else if (arg == "--concurrency" && i + 1 < argc) {
+            concurrency = std::stoi(argv[++i]);
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.size() < 2) {
+        std::cerr << "Usage: ./analysis merge [--csv file] [--concurrency n] output.bin "
+                     "input.bin [input.bin ...]"
+                  << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string> inputs(files.begin() + 1, files.end());
+
+    if (!merge_result_files(files[0], inputs)) return 1;
+
+    const ResultFile merged(files[0]);
+
+    std::cout << "Merged " << inputs.size() << " files into " << files[0] << " with "
+              << merged.size() << " positions from " << merged.header().games << " games"
+              << std::endl;
+
+    if (!csv.empty()) {
+        std::vector<ResultRow> rows;
+        rows.reserve(merged.size());
+
+        for (const auto &record : merged) {
+            rows.push_back(ResultRow::of(record.key, record.stats));
+        }
+
+        sort_results(rows, 0, concurrency);
+
+        if (!write_csv(csv, rows, concurrency)) {
+            std::cerr << "Error: could not write " << csv << std::endl;
+            return 1;
+        }
+
+        std::cout << "Wrote results to " << csv << std::endl;
+    }
+
+    return 0;
+}
+
+/// @brief ./analysis [--dir path] [--concurrency n] [--matchBook book]
+/// [--allowDuplicates] [--SPRTonly] [--matchBookInvert] [--fixFENsource file]
+/// [--cacheDir path] [--localMaps] [--pipeline readers:inflaters:parsers] [--metaIndex file]
+/// [--topN n] [--minGames n] [--binary] [--shard i/n] [--stats file.json]
+/// [--groupBy book,book_depth,sprt,test,tc] [--filter expression]
+/// [--postProcess] [--drawRateMin n] [--drawRateMax n] [--drawRateGames n]
+/// [--spill n] [--spillDir path] [--serve socket] [--treeDepth n] [--manifest file]
+/// [--approx rate] [--approxPositions n] [--checkpoint file] [--checkpointInterval s]
+/// [--resume] [--compress gzip|zstd] [--numa] [--numaNodes n] [--trace file] [--traceEvents n]
+/// ./analysis merge [--csv file] [--concurrency n] output.bin input.bin [input.bin ...]
+/// @param argc
+/// @param argv
+/// @return
+int main(int argc, char const *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        return merge_main(argc, argv);
+    }
+
+    CommandLine cmd(argc, argv);
+
+    CLIOptions options;
+
+    if (cmd.has("--dir")) {
+        options.dir = cmd.get("--dir");
+        std::cout << "Looking (recursively) for pgn files in " << options.dir << std::endl;
+    }
+
+    if (cmd.has("--concurrency")) {
+        options.concurrency = std::stoi(cmd.get("--concurrency"));
+    } else {
+        options.concurrency = std::max(1, int(std::thread::hardware_concurrency()));
+    }
+    std::cout << "Files will be processed with concurrency " << options.concurrency << std::endl;
+
+    if (cmd.has("--matchBook")) {
+        options.match_book = cmd.get("--matchBook");
+
+        if (options.match_book.empty()) {
+            std::cerr << "Error: --matchBook cannot be empty" << std::endl;
+            return 1;
+        }
+
+        if (cmd.has("--matchBookInvert")) {
+            options.matchBookInverted = true;
+        }
+        std::cout << "Filtering pgn files " << (options.matchBookInverted ? "not " : "")
+                  << "matching the book name " << options.match_book << std::endl;
+    }
+
+    if (cmd.has("--allowDuplicates")) {
+        options.allow_duplicates = true;
         std::cout << "Allow duplicate tests during the analysis." << std::endl;
     }
 
@@ -430,19 +1670,396 @@ int main(int argc, char const *argv[]) {
 
     if (cmd.has("--fixFENsource")) {
         auto file       = cmd.get("--fixFENsource");
-        options.fixfens = get_fixfen(file);
+        options.fixfens = load_fixfens(file, options.concurrency);
         std::cout << "Read in move counters to possibly fix FENs from " << file << std::endl;
     }
 
+    if (cmd.has("--cacheDir")) {
+        options.cache_dir = cmd.get("--cacheDir");
+        std::cout << "Caching the results of each pgn file in " << options.cache_dir << std::endl;
+    }
+
+    if (cmd.has("--localMaps")) {
+        options.local_maps = true;
+        std::cout << "Each thread collects the statistics in its own map." << std::endl;
+    }
+
+    if (cmd.has("--topN")) {
+        options.top_n = std::stoull(cmd.get("--topN"));
+        std::cout << "Only the first " << options.top_n << " positions will be written"
+                  << std::endl;
+    }
+
+    if (cmd.has("--minGames")) {
+        options.min_games = std::stoull(cmd.get("--minGames"));
+        std::cout << "Only positions with at least " << options.min_games
+                  << " games will be written" << std::endl;
+    }
+
+    if (cmd.has("--binary")) {
+        options.binary = true;
+        std::cout << "Writing binary results to results.bin as well" << std::endl;
+    }
+
+    if (cmd.has("--shard")) {
+        const auto shard = cmd.get("--shard");
+
+        if (std::sscanf(shard.c_str(), "%d/%d", &options.shard_index, &options.shard_count) != 2 ||
+            options.shard_count < 1 || options.shard_index < 0 ||
+            options.shard_index >= options.shard_count) {
+            std::cerr << "Error: --shard expects i/n with 0 <= i < n, e.g. 0/4" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Analysing shard " << options.shard_index << " of " << options.shard_count
+                  << ", the tests are assigned by their id" << std::endl;
+    }
+
+    if (cmd.has("--metaIndex")) {
+        options.meta_index = cmd.get("--metaIndex");
+        std::cout << "Keeping the metadata of the tests in " << options.meta_index << std::endl;
+    }
+
+    if (cmd.has("--manifest")) {
+        options.manifest_file = cmd.get("--manifest");
+        std::cout << "Keeping the list of pgn files in " << options.manifest_file << std::endl;
+    }
+
+    if (cmd.has("--pipeline")) {
+        const auto threads = cmd.get("--pipeline");
+
+        if (std::sscanf(threads.c_str(), "%d:%d:%d", &options.readers, &options.inflaters,
+                        &options.parsers) != 3 ||
+            options.readers < 1 || options.inflaters < 1 || options.parsers < 1) {
+            std::cerr << "Error: --pipeline expects readers:inflaters:parsers, e.g. 2:2:4"
+                      << std::endl;
+            return 1;
+        }
+
+        options.pipeline = true;
+        std::cout << "Reading, inflating and parsing in a pipeline with " << options.readers
+                  << "/" << options.inflaters << "/" << options.parsers << " threads"
+                  << std::endl;
+    }
+
+    if (cmd.has("--groupBy")) {
+        const auto spec       = cmd.get("--groupBy");
+        const auto dimensions = parse_group_by(spec);
+
+        if (!dimensions) {
+            std::cerr << "Error: --groupBy expects a comma separated list of book, book_depth, "
+                         "sprt, test and tc"
+                      << std::endl;
+            return 1;
+        }
+
+        // a cache entry or a private map of a thread would mix the groups of a file
+        if (groups_per_game(*dimensions) && !options.cache_dir.empty()) {
+            std::cerr << "Error: --groupBy tc cannot be combined with --cacheDir" << std::endl;
+            return 1;
+        }
+
+        if (options.local_maps) {
+            std::cerr << "Error: --groupBy cannot be combined with --localMaps" << std::endl;
+            return 1;
+        }
+
+        options.group_by = *dimensions;
+        std::cout << "Writing the results of each " << spec << " group to its own file"
+                  << std::endl;
+    }
+
+    if (cmd.has("--filter")) {
+        try {
+            options.filter = GameFilter(cmd.get("--filter"));
+        } catch (const std::invalid_argument &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+
+        std::cout << "Only analysing games which match " << options.filter.source() << std::endl;
+    }
+
+    if (cmd.has("--postProcess")) {
+        options.post_process = true;
+        std::cout << "Writing histograms of the positions to histograms.json" << std::endl;
+    }
+
+    if (cmd.has("--drawRateMin")) {
+        options.draw_rate_min = std::stoi(cmd.get("--drawRateMin"));
+    }
+
+    if (cmd.has("--drawRateMax")) {
+        options.draw_rate_max = std::stoi(cmd.get("--drawRateMax"));
+    }
+
+    if (cmd.has("--drawRateGames")) {
+        options.draw_rate_games = std::stoull(cmd.get("--drawRateGames"));
+    }
+
+    if (options.draw_rate_min || options.draw_rate_max) {
+        options.post_process = true;
+        std::cout << "Writing the positions with a draw rate of "
+                  << options.draw_rate_min.value_or(0) << "% to "
+                  << options.draw_rate_max.value_or(100) << "%, or fewer than "
+                  << options.draw_rate_games << " games, to filtered.csv and filtered.epd"
+                  << std::endl;
+    }
+
+    if (cmd.has("--spill")) {
+        options.spill_entries = std::stoull(cmd.get("--spill"));
+        options.spill_dir     = cmd.has("--spillDir") ? cmd.get("--spillDir") : ".";
+
+        // the rows of every group, or every private map, would need the limit of their own
+        if (!options.group_by.empty() || options.local_maps || options.post_process) {
+            std::cerr << "Error: --spill cannot be combined with --groupBy, --localMaps or the "
+                         "post-processing"
+                      << std::endl;
+            return 1;
+        }
+
+        spilled_results = std::make_unique<SpilledResults>(options.spill_dir,
+                                                           options.spill_entries);
+        std::cout << "Moving the positions to sorted runs in " << options.spill_dir
+                  << " whenever there are more than " << options.spill_entries << std::endl;
+    }
+
+    if (cmd.has("--serve")) {
+        options.serve_socket = cmd.get("--serve");
+
+        // the service only keeps occurance_map, and never writes results on its own
+        if (!options.group_by.empty() || options.spill_entries || options.post_process) {
+            std::cerr << "Error: --serve cannot be combined with --groupBy, --spill or the "
+                         "post-processing"
+                      << std::endl;
+            return 1;
+        }
+
+        std::cout << "Serving the results on " << options.serve_socket
+                  << " after the analysis, new files in " << options.dir << " are added"
+                  << std::endl;
+    }
+
+    if (cmd.has("--treeDepth")) {
+        options.tree_depth = std::stoull(cmd.get("--treeDepth"));
+
+        // a cached file, or a group, would need a tree of its own
+        if (!options.cache_dir.empty() || !options.group_by.empty() || options.spill_entries ||
+            !options.serve_socket.empty()) {
+            std::cerr << "Error: --treeDepth cannot be combined with --cacheDir, --groupBy, "
+                         "--spill or --serve"
+                      << std::endl;
+            return 1;
+        }
+
+        std::cout << "Counting every position up to " << options.tree_depth
+                  << " plies after the book exit in tree.csv" << std::endl;
+    }
+
+    if (cmd.has("--approxPositions")) {
+        options.approx_positions = std::stoull(cmd.get("--approxPositions"));
+    }
+
+    if (cmd.has("--approx")) {
+        options.approx_rate = std::stod(cmd.get("--approx"));
+
+        if (!(options.approx_rate > 0 && options.approx_rate <= 1)) {
+            std::cerr << "Error: --approx expects a sample rate in (0, 1]" << std::endl;
+            return 1;
+        }
+
+        // the sketch replaces the maps these work on
+        if (!options.cache_dir.empty() || !options.group_by.empty() || options.spill_entries ||
+            !options.serve_socket.empty() || options.tree_depth) {
+            std::cerr << "Error: --approx cannot be combined with --cacheDir, --groupBy, "
+                         "--spill, --serve or --treeDepth"
+                      << std::endl;
+            return 1;
+        }
+
+        approx_counter = std::make_unique<ApproxCounter>(options.approx_positions);
+
+        std::cout << "Estimating the results from " << options.approx_rate * 100
+                  << "% of the files, keeping the " << options.approx_positions
+                  << " most played positions" << std::endl;
+    }
+
+    if (cmd.has("--compress")) {
+        const auto compression = cmd.get("--compress");
+
+        if (compression == "gzip") {
+            options.csv_extension = ".csv.gz";
+        } else if (compression == "zstd" && ZSTD_SUPPORTED) {
+            options.csv_extension = ".csv.zst";
+        } else if (compression == "zstd") {
+            std::cerr << "Error: --compress zstd needs a build with libzstd" << std::endl;
+            return 1;
+        } else {
+            std::cerr << "Error: --compress expects gzip or zstd" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Compressing the results to results" << options.csv_extension
+                  << std::endl;
+    }
+
+    if (cmd.has("--checkpointInterval")) {
+        options.checkpoint_interval = std::stoull(cmd.get("--checkpointInterval"));
+    }
+
+    if (cmd.has("--checkpoint")) {
+        options.checkpoint_file = cmd.get("--checkpoint");
+        options.resume          = cmd.has("--resume");
+
+        // a checkpoint holds occurance_map, and nothing else which is built up by the files
+        if (!options.group_by.empty() || options.local_maps || options.spill_entries ||
+            !options.serve_socket.empty() || options.tree_depth || approx_counter) {
+            std::cerr << "Error: --checkpoint cannot be combined with --groupBy, --localMaps, "
+                         "--spill, --serve, --treeDepth or --approx"
+                      << std::endl;
+            return 1;
+        }
+
+        if (options.checkpoint_interval == 0) {
+            std::cerr << "Error: --checkpointInterval expects a number of seconds" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Writing a checkpoint to " << options.checkpoint_file << " every "
+                  << options.checkpoint_interval << "s" << std::endl;
+    } else if (cmd.has("--resume")) {
+        std::cerr << "Error: --resume needs the --checkpoint to resume from" << std::endl;
+        return 1;
+    }
+
+    if (cmd.has("--numa")) {
+        options.numa       = true;
+        options.numa_nodes = cmd.has("--numaNodes") ? std::stoull(cmd.get("--numaNodes")) : 0;
+
+        // the pipeline runs threads of its own, the others keep maps of their own
+        if (options.pipeline || !options.group_by.empty() || options.local_maps ||
+            options.spill_entries || !options.checkpoint_file.empty()) {
+            std::cerr << "Error: --numa cannot be combined with --pipeline, --groupBy, "
+                         "--localMaps, --spill or --checkpoint"
+                      << std::endl;
+            return 1;
+        }
+
+        numa_topology = NumaTopology::detect(options.numa_nodes);
+
+        for (std::size_t node = 0; node < numa_topology.nodes(); node++) {
+            node_maps.push_back(std::make_unique<map_t>());
+        }
+
+        std::cout << "Pinning the workers to " << numa_topology.describe()
+                  << ", each node collects the statistics in its own map" << std::endl;
+    }
+
+    if (cmd.has("--stats")) {
+        options.stats_file = cmd.get("--stats");
+        std::cout << "Writing statistics of the run to " << options.stats_file << std::endl;
+    }
+
+    if (cmd.has("--trace")) {
+        options.trace_file = cmd.get("--trace");
+
+        if (cmd.has("--traceEvents")) options.trace_events = std::stoull(cmd.get("--traceEvents"));
+
+        // the threads of the run record their spans from the start
+        Trace::enable(options.trace_events);
+
+        std::cout << "Writing a trace of the threads to " << options.trace_file << std::endl;
+    }
+
+    if (std::error_code ec; !fs::is_directory(options.dir, ec)) {
+        std::cerr << "Error: " << options.dir << " is not a directory" << std::endl;
+        return 1;
+    }
+
+    thread_stats("main");
+
     const auto t0 = std::chrono::high_resolution_clock::now();
-    process(options);
+
+    // started before the first scan of --dir, so that no new file is missed
+    std::unique_ptr<DirectoryWatcher> watcher;
+
+    if (!options.serve_socket.empty()) watcher = std::make_unique<DirectoryWatcher>(options.dir);
+
+    if (!options.checkpoint_file.empty()) {
+        const auto fingerprint = checkpoint_fingerprint(options);
+        CheckpointState state;
+
+        if (std::error_code ec; options.resume && fs::exists(options.checkpoint_file, ec)) {
+            if (!Checkpointer::load(options.checkpoint_file, fingerprint, occurance_map, state)) {
+                return 1;
+            }
+
+            total_games = state.games;
+
+            std::cout << "Resuming from the checkpoint with " << state.games << " games of "
+                      << state.files.size() << " files" << std::endl;
+        } else if (options.resume) {
+            std::cout << "No checkpoint " << options.checkpoint_file
+                      << " yet, starting from the beginning" << std::endl;
+        }
+
+        checkpoints = std::make_unique<Checkpointer>(
+            options.checkpoint_file, fingerprint,
+            std::chrono::seconds(options.checkpoint_interval), occurance_map, std::move(state));
+    }
+
+    const auto files = process(options);
+
+    if (checkpoints) {
+        run_stats.info()["checkpoints"] = {
+            {"written", checkpoints->written()},
+            {"longest_pause_seconds", checkpoints->longest_pause()}};
+
+        checkpoints.reset();
+    }
+
     const auto t1 = std::chrono::high_resolution_clock::now();
 
     std::cout << "\nTime taken: "
               << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() / 1000.0
               << "s" << std::endl;
 
-    write_results();
+    if constexpr (COUNTS_ALLOCATIONS) {
+        std::cout << "Heap allocations per game: " << RunStats::allocations_per_game()
+                  << std::endl;
+    }
+
+    if (watcher) {
+        if (!serve(options, *watcher, files)) return 1;
+    } else {
+        write_results(options);
+
+        // the results are complete, a later --resume starts from the beginning
+        if (!options.checkpoint_file.empty()) Checkpointer::remove(options.checkpoint_file);
+    }
+
+    if (!options.stats_file.empty()) {
+        const auto t2 = std::chrono::high_resolution_clock::now();
+
+        run_stats.info()["wall_seconds"] = std::chrono::duration<double>(t2 - t0).count();
+
+        if (!run_stats.write(options.stats_file)) {
+            std::cerr << "Error: could not write " << options.stats_file << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options.trace_file.empty()) {
+        if (!Trace::write(options.trace_file)) {
+            std::cerr << "Error: could not write " << options.trace_file << std::endl;
+            return 1;
+        }
+
+        if (const auto dropped = Trace::dropped()) {
+            std::cout << "The trace lost its " << dropped
+                      << " oldest spans, --traceEvents keeps more of them per thread" << std::endl;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,215 @@
+#include "approx.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace {
+// splitmix64 finalizer, derives independent looking hashes from the hash of a key
+std::uint64_t mix(std::uint64_t x) noexcept {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+std::size_t outcome(Result result) noexcept {
+    if (result == Result::WIN) return 0;
+    if (result == Result::DRAW) return 1;
+    return 2;
+}
+}  // namespace
+
+ApproxCounter::ApproxCounter(std::size_t candidates)
+    : candidates_(std::max<std::size_t>(1, candidates)),
+      cells_(new Cell[WIDTH * DEPTH]),
+      registers_(new std::atomic<std::uint8_t>[std::size_t(1) << HLL_BITS]) {
+    for (std::size_t i = 0; i < (std::size_t(1) << HLL_BITS); i++) registers_[i] = 0;
+}
+
+std::array<std::size_t, ApproxCounter::DEPTH> ApproxCounter::cells_of(
+    std::uint64_t hash) const noexcept {
+    // the rows use h1 + i * h2, which is as good as independent hash functions for a sketch
+    const auto h1 = mix(hash);
+    const auto h2 = mix(hash ^ 0x9e3779b97f4a7c15ULL) | 1;
+
+    std::array<std::size_t, DEPTH> cells;
+
+    for (std::size_t i = 0; i < DEPTH; i++) {
+        cells[i] = i * WIDTH + ((h1 + i * h2) & (WIDTH - 1));
+    }
+
+    return cells;
+}
+
+Statistics ApproxCounter::estimate(const std::array<std::size_t, DEPTH> &cells) const {
+    std::array<std::uint64_t, 3> counts;
+
+    for (std::size_t o = 0; o < 3; o++) {
+        counts[o] = UINT64_MAX;
+
+        for (const auto cell : cells) {
+            counts[o] = std::min<std::uint64_t>(
+                counts[o], cells_[cell].counts[o].load(std::memory_order_relaxed));
+        }
+    }
+
+    return {counts[0], counts[1], counts[2]};
+}
+
+ApproxCounter::Candidates &ApproxCounter::thread_candidates() {
+    thread_local const ApproxCounter *owner = nullptr;
+    thread_local Candidates *candidates     = nullptr;
+
+    if (owner != this) {
+        const std::lock_guard<std::mutex> lock(mutex_);
+
+        auto &entry = threads_[std::this_thread::get_id()];
+        if (!entry) entry = std::make_unique<Candidates>();
+
+        owner      = this;
+        candidates = entry.get();
+    }
+
+    return *candidates;
+}
+
+void ApproxCounter::add(const PositionKey &key, Result result) {
+    const auto hash  = PositionKeyHash()(key);
+    const auto cells = cells_of(hash);
+
+    for (const auto cell : cells) {
+        cells_[cell].counts[outcome(result)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the first bits pick a register, which keeps the longest run of zeros of the rest
+    const auto h     = mix(hash + 0x632be59bd9b4e019ULL);
+    const auto index = h >> (64 - HLL_BITS);
+    auto rest        = h << HLL_BITS;
+    std::uint8_t run = 1;
+
+    while (run <= 64 - HLL_BITS && !(rest >> 63)) {
+        rest <<= 1;
+        run++;
+    }
+
+    auto &reg     = registers_[index];
+    auto previous = reg.load(std::memory_order_relaxed);
+
+    while (previous < run && !reg.compare_exchange_weak(previous, run)) {
+    }
+
+    auto &candidates = thread_candidates();
+    candidates[key]  = estimate(cells).total();
+
+    // pruning only every candidates_ new positions keeps the cost per game constant
+    if (candidates.size() >= 2 * candidates_) prune(candidates);
+}
+
+void ApproxCounter::prune(Candidates &candidates) const {
+    std::vector<std::uint64_t> counts;
+    counts.reserve(candidates.size());
+
+    for (const auto &[key, count] : candidates) counts.push_back(count);
+
+    std::nth_element(counts.begin(), counts.begin() + (candidates_ - 1), counts.end(),
+                     std::greater<>());
+
+    const auto threshold = counts[candidates_ - 1];
+
+    // exactly candidates_ are left, of the ties at the threshold only as many as fit
+    auto ties = std::count(counts.begin(), counts.begin() + candidates_, threshold);
+
+    for (auto it = candidates.begin(); it != candidates.end();) {
+        if (it->second < threshold || (it->second == threshold && ties-- <= 0)) {
+            candidates.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ApproxCounter::collect(map_t &target, double scale) const {
+    Candidates all;
+
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+
+        for (const auto &[id, candidates] : threads_) {
+            for (const auto &[key, count] : *candidates) all[key] = 0;
+        }
+    }
+
+    // estimated again, the estimate a thread kept is from its last game of the position
+    for (auto &[key, count] : all) count = estimate(cells_of(PositionKeyHash()(key))).total();
+
+    if (all.size() > candidates_) prune(all);
+
+    const auto scaled = [scale](std::uint64_t count) {
+        return static_cast<std::size_t>(std::llround(count * scale));
+    };
+
+    for (const auto &[key, count] : all) {
+        const auto stats = estimate(cells_of(PositionKeyHash()(key)));
+
+        target[key] = {scaled(stats.wins), scaled(stats.draws), scaled(stats.losses)};
+    }
+}
+
+Statistics ApproxCounter::totals() const {
+    // every game adds one to each row, so the sum of a row is exact
+    Statistics totals;
+
+    for (std::size_t i = 0; i < WIDTH; i++) {
+        totals.wins += cells_[i].counts[0].load(std::memory_order_relaxed);
+        totals.draws += cells_[i].counts[1].load(std::memory_order_relaxed);
+        totals.losses += cells_[i].counts[2].load(std::memory_order_relaxed);
+    }
+
+    return totals;
+}
+
+double ApproxCounter::distinct_positions() const {
+    constexpr std::size_t m = std::size_t(1) << HLL_BITS;
+
+    double sum        = 0;
+    std::size_t zeros = 0;
+
+    for (std::size_t i = 0; i < m; i++) {
+        const auto run = registers_[i].load(std::memory_order_relaxed);
+
+        sum += std::ldexp(1.0, -run);
+        zeros += run == 0;
+    }
+
+    const double alpha    = 0.7213 / (1 + 1.079 / m);
+    const double estimate = alpha * m * m / sum;
+
+    // linear counting is more precise while many registers are still empty
+    if (estimate <= 2.5 * m && zeros) return m * std::log(double(m) / zeros);
+
+    return estimate;
+}
+
+nlohmann::json ApproxCounter::bounds(double scale) const {
+    const auto totals = this->totals();
+
+    return {{"scale", scale},
+            {"count_min",
+             {{"width", WIDTH},
+              {"depth", DEPTH},
+              {"epsilon", EPSILON},
+              {"delta", DELTA},
+              // with probability 1 - delta, an estimate is at most this much too high
+              {"max_overcount",
+               {{"wins", EPSILON * totals.wins * scale},
+                {"draws", EPSILON * totals.draws * scale},
+                {"losses", EPSILON * totals.losses * scale}}}}},
+            {"distinct_positions_sampled",
+             {{"estimate", distinct_positions()}, {"relative_error", HLL_RELATIVE_ERROR}}},
+            {"candidates", candidates_}};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../external/json.hpp"
+#include "../external/parallel_hashmap/phmap.h"
+#include "./position_key.hpp"
+#include "./statistics.hpp"
+
+/// @brief Counts the games of --approx in fixed memory. The wins, draws and losses of every
+/// position go into a count-min sketch, which never undercounts and overcounts by at most
+/// EPSILON times the games of that outcome with probability 1 - DELTA. Each thread keeps the
+/// positions with the highest estimates as candidates, and a HyperLogLog estimates the number
+/// of distinct positions seen.
+class ApproxCounter {
+   public:
+    static constexpr std::size_t WIDTH = 1 << 18;
+    static constexpr std::size_t DEPTH = 4;
+
+    // e / WIDTH and e^-DEPTH
+    static constexpr double EPSILON = 2.718281828459045 / WIDTH;
+    static constexpr double DELTA   = 0.01831563888873418;
+
+    // 2^14 registers of the HyperLogLog, 1.04 / sqrt(2^14) standard error
+    static constexpr unsigned HLL_BITS         = 14;
+    static constexpr double HLL_RELATIVE_ERROR = 1.04 / 128;
+
+    /// @param candidates positions each thread tracks, the same number is written at most
+    ApproxCounter(std::size_t candidates);
+
+    ApproxCounter(const ApproxCounter &)            = delete;
+    ApproxCounter &operator=(const ApproxCounter &) = delete;
+
+    /// @brief Counts one game, safe to call from any number of threads.
+    /// @param key
+    /// @param result
+    void add(const PositionKey &key, Result result);
+
+    /// @brief The estimates of the candidates of all threads, scaled to the whole input.
+    /// @param target
+    /// @param scale
+    void collect(map_t &target, double scale) const;
+
+    /// @brief The games counted by the sketch, which are exact.
+    [[nodiscard]] Statistics totals() const;
+
+    [[nodiscard]] double distinct_positions() const;
+
+    /// @brief The error bounds of the estimates for the results written by collect().
+    /// @param scale
+    /// @return
+    [[nodiscard]] nlohmann::json bounds(double scale) const;
+
+   private:
+    using Candidates = phmap::flat_hash_map<PositionKey, std::uint64_t, PositionKeyHash>;
+
+    struct Cell {
+        std::array<std::atomic<std::uint64_t>, 3> counts = {};
+    };
+
+    [[nodiscard]] std::array<std::size_t, DEPTH> cells_of(std::uint64_t hash) const noexcept;
+
+    [[nodiscard]] Statistics estimate(const std::array<std::size_t, DEPTH> &cells) const;
+
+    Candidates &thread_candidates();
+
+    void prune(Candidates &candidates) const;
+
+    std::size_t candidates_;
+
+    std::unique_ptr<Cell[]> cells_;
+    std::unique_ptr<std::atomic<std::uint8_t>[]> registers_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<Candidates>> threads_;
+};
@@ -0,0 +1,491 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../external/chess.hpp"
+#include "../external/gzip/gzstream.h"
+#include "./fen_normalizer.hpp"
+#include "./gz_reader.hpp"
+#include "./pgn_generator.hpp"
+#include "./pgn_scanner.hpp"
+#include "./results.hpp"
+#include "./statistics.hpp"
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__) || defined(__MACH__)
+#    include <sys/resource.h>
+#    define HAS_RUSAGE 1
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Measurement {
+    std::size_t bytes = 0;
+    double seconds    = 0;
+};
+
+template <typename FUNC>
+Measurement measure(FUNC f) {
+    const auto t0      = std::chrono::steady_clock::now();
+    const auto bytes   = f();
+    const auto t1      = std::chrono::steady_clock::now();
+    const auto seconds = std::chrono::duration<double>(t1 - t0).count();
+    return {bytes, seconds};
+}
+
+std::size_t read_istream(std::istream &is) {
+    std::vector<char> buffer(1 << 20);
+    std::size_t bytes = 0;
+
+    while (is) {
+        is.read(buffer.data(), buffer.size());
+        bytes += is.gcount();
+    }
+
+    return bytes;
+}
+
+void report(const std::string &name, const Measurement &m) {
+    std::cout << "  " << std::left << std::setw(14) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << m.bytes / 1e6 << " MB " << std::setw(8)
+              << std::setprecision(3) << m.seconds << " s " << std::setw(10)
+              << std::setprecision(1) << m.bytes / 1e6 / m.seconds << " MB/s" << std::endl;
+}
+
+// decompression speed of the old igzstream against the GzFileReader based backends
+void bench_gzip(const std::string &file) {
+    std::cout << file << std::endl;
+
+    // warm up the page cache, so that all candidates read from memory
+    {
+        std::ifstream raw(file, std::ios::binary);
+        read_istream(raw);
+    }
+
+    report("igzstream", measure([&]() {
+               igzstream is(file.c_str());
+               return read_istream(is);
+           }));
+
+    report("GzStream", measure([&]() {
+               GzStream is(file);
+               return read_istream(is);
+           }));
+
+    report("GzFileReader", measure([&]() {
+               GzFileReader reader(file);
+               std::size_t bytes = 0;
+
+               while (!reader.eof()) {
+                   bytes += reader.next().size();
+               }
+
+               return bytes;
+           }));
+}
+
+// collects the FEN header of every game, these are the keys the analysis aggregates
+class FenCollector : public chess::pgn::Visitor {
+   public:
+    FenCollector(std::vector<std::string> &fens) : fens(fens) {}
+
+    void startPgn() override { fen = chess::constants::STARTPOS; }
+
+    void header(std::string_view key, std::string_view value) override {
+        if (key == "FEN") fen = value;
+    }
+
+    void startMoves() override {
+        skipPgn(true);
+        fens.push_back(fen);
+    }
+
+    void move(std::string_view, std::string_view) override {}
+
+    void endPgn() override {}
+
+   private:
+    std::vector<std::string> &fens;
+    std::string fen;
+};
+
+std::vector<std::string> collect_fens(const std::vector<std::string> &files) {
+    std::vector<std::string> fens;
+    FenCollector collector(fens);
+
+    for (const auto &file : files) {
+        PgnHeaderScanner scanner(collector);
+
+        if (file.size() >= 3 && file.substr(file.size() - 3) == ".gz") {
+            GzFileReader reader(file);
+            std::size_t keep = 0;
+
+            while (!reader.eof()) {
+                const auto chunk = reader.next(keep);
+                keep             = chunk.size() - scanner.feed(chunk, reader.eof());
+            }
+        } else {
+            MappedFile mapped(file);
+            scanner.feed(mapped.view(), true);
+        }
+    }
+
+    return fens;
+}
+
+void insert(map_t &stats_map, const PositionKey &key) {
+    stats_map.lazy_emplace_l(
+        key, [&](map_t::value_type &v) { v.second.draws++; },
+        [&](const map_t::constructor &ctor) { ctor(key, Statistics{0, 1, 0}); });
+}
+
+// insert rate of the shared map against private maps per thread, which are merged afterwards
+void bench_aggregate(const std::vector<std::string> &files, int max_threads) {
+    std::vector<PositionKey> keys;
+
+    for (const auto &fen : collect_fens(files)) {
+        if (const auto key = PositionKey::from_fen(fen)) keys.push_back(*key);
+    }
+
+    std::cout << keys.size() << " keys" << std::endl;
+    std::cout << "  threads    global (Mkeys/s)    local (Mkeys/s)" << std::endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        const auto run = [&](auto &&work) {
+            std::vector<std::thread> workers;
+
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    for (std::size_t i = t; i < keys.size(); i += threads) {
+                        work(t, keys[i]);
+                    }
+                });
+            }
+
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        };
+
+        const auto global = measure([&]() {
+            map_t stats_map;
+            run([&](int, const PositionKey &key) { insert(stats_map, key); });
+            return keys.size();
+        });
+
+        const auto local = measure([&]() {
+            map_t stats_map;
+            std::vector<map_t> local_maps(threads);
+            std::vector<map_t *> sources;
+
+            run([&](int t, const PositionKey &key) { insert(local_maps[t], key); });
+
+            for (auto &local_map : local_maps) {
+                sources.push_back(&local_map);
+            }
+
+            merge_parallel(stats_map, sources, threads);
+            return keys.size();
+        });
+
+        std::cout << "  " << std::setw(7) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(18) << global.bytes / 1e6 / global.seconds << std::setw(19)
+                  << local.bytes / 1e6 / local.seconds << std::endl;
+    }
+}
+
+// the normalization done by the Analyzer before, a regex and a std::string keyed map per game
+std::optional<PositionKey> normalize_regex(
+    const std::string &fen, const std::unordered_map<std::string, std::pair<int, int>> &fixfens) {
+    std::regex p("^(.+) 0 1$");
+    std::smatch match;
+
+    if (std::regex_search(fen, match, p) && match.size() > 1) {
+        std::string position = match[1];
+        const auto it        = fixfens.find(position);
+
+        if (it == fixfens.end()) return std::nullopt;
+
+        return PositionKey::from_fen(position + " " + std::to_string(it->second.first) + " " +
+                                     std::to_string(it->second.second));
+    }
+
+    return PositionKey::from_fen(fen);
+}
+
+// time per game to turn the FEN header into a key with --fixFENsource, and the book load time
+void bench_normalize(const std::string &book, const std::vector<std::string> &files,
+                     int max_threads) {
+    std::cout << book << std::endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::size_t positions = 0;
+
+        const auto load = measure([&]() {
+            positions = load_fixfens(book, threads).size();
+            return positions;
+        });
+
+        std::cout << "  load " << positions << " positions with " << threads << " threads "
+                  << std::fixed << std::setprecision(3) << load.seconds << " s" << std::endl;
+    }
+
+    const auto fixfens = load_fixfens(book, max_threads);
+    const auto fens    = collect_fens(files);
+
+    std::unordered_map<std::string, std::pair<int, int>> fixfens_std(fixfens.begin(),
+                                                                     fixfens.end());
+
+    std::cout << fens.size() << " games" << std::endl;
+
+    const auto per_game = [&](const std::string &name, const Measurement &m) {
+        std::cout << "  " << std::left << std::setw(14) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << m.seconds * 1e9 / m.bytes
+                  << " ns/game" << std::endl;
+    };
+
+    std::size_t packed = 0;
+
+    per_game("regex", measure([&]() {
+                 for (const auto &fen : fens) {
+                     packed += normalize_regex(fen, fixfens_std).has_value();
+                 }
+                 return fens.size();
+             }));
+
+    per_game("normalize_fen", measure([&]() {
+                 bool missing = false;
+                 for (const auto &fen : fens) {
+                     packed += normalize_fen(fen, fixfens, missing).has_value();
+                 }
+                 return fens.size();
+             }));
+
+    // keeps the loops from being optimized away
+    std::cout << "  " << packed << " keys" << std::endl;
+}
+
+struct Options {
+    int threads        = std::max(1, int(std::thread::hardware_concurrency()));
+    std::size_t games  = 20000;
+    std::uint64_t seed = 1;
+    std::vector<std::string> files;
+};
+
+// writes games.pgn, games.pgn.gz and book.epd to dir
+GeneratedPgns generate(const std::string &dir, const Options &options) {
+    fs::create_directories(dir);
+
+    const auto t0         = std::chrono::steady_clock::now();
+    auto generated        = generate_pgns(options.games, options.seed);
+    const auto compressed = gzip_compress(generated.pgn);
+    const auto t1         = std::chrono::steady_clock::now();
+
+    std::ofstream(dir + "/games.pgn", std::ios::binary) << generated.pgn;
+    std::ofstream(dir + "/games.pgn.gz", std::ios::binary) << compressed;
+    std::ofstream(dir + "/book.epd", std::ios::binary) << generated.book;
+
+    std::cout << "generated " << generated.games << " games, " << std::fixed
+              << std::setprecision(1) << generated.pgn.size() / 1e6 << " MB ("
+              << compressed.size() / 1e6 << " MB compressed) in " << std::setprecision(3)
+              << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+
+    return generated;
+}
+
+// every stage reports its own high water mark, which the kernel resets on request
+void reset_peak_rss() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+// in kB, 0 if the platform offers no way to query it
+std::size_t peak_rss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) return std::stoull(line.substr(6));
+    }
+
+#ifdef HAS_RUSAGE
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss;
+#endif
+
+    return 0;
+}
+
+template <typename FUNC>
+void stage(const std::string &name, std::size_t games, FUNC f) {
+    reset_peak_rss();
+
+    const auto m = measure(f);
+
+    std::cout << "  " << std::left << std::setw(12) << name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(8) << m.seconds << " s " << std::setw(10)
+              << std::setprecision(0) << games / m.seconds << " games/s " << std::setw(8)
+              << std::setprecision(1) << m.bytes / 1e6 / m.seconds << " MB/s " << std::setw(8)
+              << peak_rss() / 1024.0 << " MB peak" << std::endl;
+}
+
+// walks through every move like the Analyzer does without a book, to time the full parser
+class MoveCounter : public chess::pgn::Visitor {
+   public:
+    void startPgn() override {}
+    void header(std::string_view, std::string_view) override {}
+    void startMoves() override {}
+    void move(std::string_view, std::string_view) override { moves++; }
+    void endPgn() override {}
+
+    std::size_t moves = 0;
+};
+
+// times every stage of the analysis on generated games, from the decompression to the csv. The
+// throughput of every stage is given relative to the size of the PGNs, so that they compare.
+void bench_suite(const std::string &dir, const Options &options) {
+    const auto generated = generate(dir, options);
+
+    const auto pgn  = dir + "/games.pgn";
+    const auto gz   = dir + "/games.pgn.gz";
+    const auto book = dir + "/book.epd";
+
+    const auto games = generated.games;
+    const auto bytes = generated.pgn.size();
+
+    std::cout << "  stage              time       throughput" << std::endl;
+
+    stage("decompress", games, [&]() {
+        GzFileReader reader(gz);
+        std::size_t size = 0;
+
+        while (!reader.eof()) {
+            size += reader.next().size();
+        }
+
+        return size;
+    });
+
+    stage("parse", games, [&]() {
+        std::ifstream is(pgn, std::ios::binary);
+        MoveCounter counter;
+        chess::pgn::StreamParser parser(is);
+        parser.readGames(counter);
+        return bytes;
+    });
+
+    std::vector<std::string> fens;
+
+    stage("scan", games, [&]() {
+        fens = collect_fens({pgn});
+        return bytes;
+    });
+
+    std::vector<PositionKey> keys;
+
+    stage("normalize", games, [&]() {
+        const auto fixfens = load_fixfens(book, options.threads);
+        bool missing       = false;
+
+        for (const auto &fen : fens) {
+            if (const auto key = normalize_fen(fen, fixfens, missing)) keys.push_back(*key);
+        }
+
+        return bytes;
+    });
+
+    map_t stats_map;
+
+    stage("aggregate", games, [&]() {
+        for (const auto &key : keys) {
+            insert(stats_map, key);
+        }
+
+        return bytes;
+    });
+
+    stage("write", games, [&]() {
+        const auto rows = sorted_results(stats_map, 0, 0, options.threads);
+        write_csv(dir + "/results.csv", rows, options.threads);
+        return bytes;
+    });
+
+    std::cout << "  " << keys.size() << " keys, " << stats_map.size() << " positions"
+              << std::endl;
+}
+
+void usage() {
+    std::cerr << "Usage: ./benchmark gzip file.pgn.gz [file.pgn.gz ...]\n"
+              << "       ./benchmark aggregate [--threads n] file.pgn[.gz] [...]\n"
+              << "       ./benchmark normalize [--threads n] book.epd[.gz] file.pgn[.gz] [...]\n"
+              << "       ./benchmark generate [--games n] [--seed s] dir\n"
+              << "       ./benchmark suite [--games n] [--seed s] [--threads n] dir" << std::endl;
+}
+
+}  // namespace
+
+/// @brief ./benchmark gzip file.pgn.gz [file.pgn.gz ...]
+/// ./benchmark aggregate [--threads n] file.pgn[.gz] [...]
+/// ./benchmark normalize [--threads n] book.epd[.gz] file.pgn[.gz] [...]
+/// ./benchmark generate [--games n] [--seed s] dir
+/// ./benchmark suite [--games n] [--seed s] [--threads n] dir
+/// @param argc
+/// @param argv
+/// @return
+int main(int argc, char const *argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    const std::string mode = argv[1];
+
+    if (mode == "gzip") {
+        for (int i = 2; i < argc; i++) {
+            bench_gzip(argv[i]);
+        }
+    } else if (mode == "aggregate" || mode == "normalize" || mode == "generate" ||
+               mode == "suite") {
+        Options options;
+
+        for (int i = 2; i < argc; i++) {
+            const std::string arg = argv[i];
+
+            if (arg == "--threads" && i + 1 < argc) {
+                options.threads = std::stoi(argv[++i]);
+            } else if (arg == "--games" && i + 1 < argc) {
+                options.games = std::stoull(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                options.seed = std::stoull(argv[++i]);
+            } else {
+                options.files.push_back(arg);
+            }
+        }
+
+        const auto &files = options.files;
+
+        if (mode == "aggregate") {
+            bench_aggregate(files, options.threads);
+        } else if (mode == "normalize" && files.size() >= 2) {
+            bench_normalize(files[0], {files.begin() + 1, files.end()}, options.threads);
+        } else if (mode == "generate" && files.size() == 1) {
+            generate(files[0], options);
+        } else if (mode == "suite" && files.size() == 1) {
+            bench_suite(files[0], options);
+        } else {
+            usage();
+            return 1;
+        }
+    } else {
+        usage();
+        return 1;
+    }
+
+    return 0;
+}
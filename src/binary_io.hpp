@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "./position_key.hpp"
+
+/// @brief Size and modification time of a file, used to tell whether derived data is stale.
+struct FileInfo {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    bool valid         = false;
+};
+
+[[nodiscard]] inline FileInfo file_info(const std::string &file) {
+    std::error_code ec;
+    FileInfo info;
+
+    info.size = std::filesystem::file_size(file, ec);
+    if (ec) return info;
+
+    info.mtime = std::filesystem::last_write_time(file, ec).time_since_epoch().count();
+    if (ec) return info;
+
+    info.valid = true;
+    return info;
+}
+
+template <typename T>
+void write_pod(std::ostream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read_pod(std::istream &is, T &value) {
+    return static_cast<bool>(is.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+inline void write_string(std::ostream &os, const std::string &str) {
+    write_pod(os, static_cast<std::uint32_t>(str.size()));
+    os.write(str.data(), str.size());
+}
+
+inline bool read_string(std::istream &is, std::string &str) {
+    std::uint32_t size = 0;
+    if (!read_pod(is, size)) return false;
+
+    str.resize(size);
+    return static_cast<bool>(is.read(str.data(), size));
+}
+
+/// @brief Writes the texts of raw keys, see PositionKey::from_raw_fen(), as a count followed
+/// by each key and its FEN.
+/// @param os
+/// @param keys
+inline void write_raw_fens(std::ostream &os, const std::vector<PositionKey> &keys) {
+    write_pod(os, static_cast<std::uint64_t>(keys.size()));
+
+    for (const auto &key : keys) {
+        write_pod(os, key);
+        write_string(os, key.to_fen());
+    }
+}
+
+/// @brief Registers the texts written by write_raw_fens().
+/// @param is
+/// @return false if the texts are truncated
+inline bool read_raw_fens(std::istream &is) {
+    std::uint64_t count = 0;
+    if (!read_pod(is, count)) return false;
+
+    PositionKey key;
+    std::string fen;
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        if (!read_pod(is, key) || !read_string(is, fen)) return false;
+
+        PositionKey::add_raw_fen(key, fen);
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/// @brief Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+/// Every cell carries a sequence number which tells producers and consumers whether the
+/// cell is free for the current lap, so neither side ever takes a lock.
+template <typename T>
+class BoundedQueue {
+   public:
+    /// @brief The capacity is rounded up to a power of two.
+    /// @param capacity
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+
+        mask_  = size - 1;
+        cells_ = std::make_unique<Cell[]>(size);
+
+        for (std::size_t i = 0; i < size; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &)            = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /// @brief Moves value into the queue unless it is full.
+    /// @param value
+    /// @return false if the queue is full, value is left untouched then
+    bool try_push(T &value) {
+        auto pos = tail_.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto &cell     = cells_[pos & mask_];
+            const auto seq = cell.sequence.load(std::memory_order_acquire);
+            const auto dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Moves the oldest element into value unless the queue is empty.
+    /// @param value
+    /// @return false if the queue is empty
+    bool try_pop(T &value) {
+        auto pos = head_.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto &cell     = cells_[pos & mask_];
+            const auto seq = cell.sequence.load(std::memory_order_acquire);
+            const auto dif =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Waits until there is room for value.
+    /// @param value
+    void push(T value) {
+        for (int tries = 0; !try_push(value); tries++) backoff(tries);
+    }
+
+    /// @brief Waits until an element is available.
+    /// @return
+    T pop() {
+        T value;
+        for (int tries = 0; !try_pop(value); tries++) backoff(tries);
+        return value;
+    }
+
+   private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    // a stage usually waits for I/O or for a slower stage, so spinning stops quickly
+    static void backoff(int tries) {
+        if (tries < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_ = 0;
+
+    // producers and consumers touch different cache lines
+    alignas(64) std::atomic<std::size_t> tail_ = 0;
+    alignas(64) std::atomic<std::size_t> head_ = 0;
+};
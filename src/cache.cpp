@@ -0,0 +1,139 @@
+#include "cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "./binary_io.hpp"
+#include "./utils.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// bump whenever the entry layout or the analysis semantics change
+constexpr std::uint32_t CACHE_VERSION = 4;
+constexpr char CACHE_MAGIC[8]         = {'A', 'N', 'A', 'C', 'A', 'C', 'H', 'E'};
+}  // namespace
+
+std::uint64_t options_fingerprint(const CLIOptions &options) {
+    std::uint64_t hash = stable_hash("analysis-cache");
+
+    // combined order independent, the map does not preserve the order of the source
+    std::uint64_t fixfens = 0;
+    for (const auto &[fen, counters] : options.fixfens) {
+        const auto suffix =
+            " " + std::to_string(counters.first) + " " + std::to_string(counters.second);
+        fixfens += stable_hash(suffix, stable_hash(fen));
+    }
+
+    hash = stable_hash(std::to_string(fixfens), hash);
+
+    // left out without a filter, so that existing entries stay valid
+    if (!options.filter.empty()) hash = stable_hash(options.filter.source(), hash);
+
+    return hash;
+}
+
+ResultCache::ResultCache(const std::string &dir, const CLIOptions &options)
+    : dir_(dir), fingerprint_(options_fingerprint(options)) {
+    fs::create_directories(dir_);
+}
+
+std::string ResultCache::entry_path(const std::string &file) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cache",
+                  static_cast<unsigned long long>(stable_hash(fs::absolute(file).string())));
+    return (fs::path(dir_) / name).string();
+}
+
+bool ResultCache::load(const std::string &file, const FileInfo &info, map_t &stats_map,
+                       std::size_t &games) const {
+    if (!info.valid) return false;
+
+    std::ifstream is(entry_path(file), std::ios::binary);
+    if (!is.is_open()) return false;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    std::uint32_t version     = 0;
+    std::uint64_t fingerprint = 0, size = 0, count = 0, cached_games = 0;
+    std::int64_t mtime        = 0;
+    std::string path;
+
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !read_pod(is, version) || version != CACHE_VERSION || !read_pod(is, fingerprint) ||
+        fingerprint != fingerprint_ || !read_string(is, path) ||
+        path != fs::absolute(file).string() || !read_pod(is, size) || size != info.size ||
+        !read_pod(is, mtime) || mtime != info.mtime || !read_pod(is, cached_games) ||
+        !read_pod(is, count)) {
+        return false;
+    }
+
+    map_t entries;
+    entries.reserve(count);
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        PositionKey key;
+        Statistics stats;
+
+        if (!read_pod(is, key) || !read_pod(is, stats)) return false;
+
+        entries.emplace(key, stats);
+    }
+
+    if (!read_raw_fens(is)) return false;
+
+    merge_into(stats_map, entries);
+    games = cached_games;
+
+    return true;
+}
+
+void ResultCache::store(const std::string &file, const FileInfo &info, const map_t &stats_map,
+                        std::size_t games) const {
+    if (!info.valid) return;
+
+    const auto path = entry_path(file);
+    const auto tmp  = path + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+
+        os.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        write_pod(os, CACHE_VERSION);
+        write_pod(os, fingerprint_);
+        write_string(os, fs::absolute(file).string());
+        write_pod(os, info.size);
+        write_pod(os, info.mtime);
+        write_pod(os, static_cast<std::uint64_t>(games));
+        write_pod(os, static_cast<std::uint64_t>(stats_map.size()));
+
+        std::vector<PositionKey> raw;
+
+        for (const auto &[key, stats] : stats_map) {
+            write_pod(os, key);
+            write_pod(os, stats);
+
+            if (key.is_raw()) raw.push_back(key);
+        }
+
+        write_raw_fens(os, raw);
+
+        if (!os) {
+            std::cerr << "Warning: could not write cache entry for " << file << std::endl;
+            return;
+        }
+    }
+
+    // entries are replaced atomically, an interrupted run never leaves a truncated one behind
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+
+    if (ec) {
+        std::cerr << "Warning: could not write cache entry for " << file << std::endl;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "./binary_io.hpp"
+#include "./options.hpp"
+#include "./statistics.hpp"
+
+/// @brief Everything that changes the statistics collected from a file.
+/// @param options
+/// @return
+[[nodiscard]] std::uint64_t options_fingerprint(const CLIOptions &options);
+
+/// @brief Persistent per-file results, so that unchanged pgn files are not parsed again.
+/// An entry is valid as long as size and modification time of the file and the
+/// fingerprint of the analysis options match.
+class ResultCache {
+   public:
+    ResultCache(const std::string &dir, const CLIOptions &options);
+
+    /// @brief Adds the cached statistics of file to stats_map.
+    /// @param file
+    /// @param info the file as it is now, taken before it is analysed in case of a miss
+    /// @param stats_map
+    /// @param games
+    /// @return false if there is no valid entry
+    bool load(const std::string &file, const FileInfo &info, map_t &stats_map,
+              std::size_t &games) const;
+
+    /// @brief Writes the statistics of file, replacing any previous entry.
+    /// @param file
+    /// @param info the file before it was analysed, a file which changed while it was read is
+    /// analysed again by the next run
+    /// @param stats_map
+    /// @param games
+    void store(const std::string &file, const FileInfo &info, const map_t &stats_map,
+               std::size_t games) const;
+
+   private:
+    [[nodiscard]] std::string entry_path(const std::string &file) const;
+
+    std::string dir_;
+    std::uint64_t fingerprint_;
+};
@@ -0,0 +1,209 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "./binary_io.hpp"
+#include "./cache.hpp"
+#include "./utils.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// bump whenever the layout of a checkpoint changes
+constexpr std::uint32_t CHECKPOINT_VERSION = 2;
+constexpr char CHECKPOINT_MAGIC[8]         = {'A', 'N', 'A', 'C', 'H', 'K', 'P', 'T'};
+}  // namespace
+
+std::uint64_t checkpoint_fingerprint(const CLIOptions &options) {
+    auto hash = stable_hash("analysis-checkpoint", options_fingerprint(options));
+
+    // the files of a checkpoint are kept by path, another --dir would not find them
+    hash = stable_hash(options.dir, hash);
+    hash = stable_hash(options.match_book + (options.matchBookInverted ? " invert" : ""), hash);
+    hash = stable_hash(std::to_string(options.only_sprt) + std::to_string(options.allow_duplicates),
+                       hash);
+    hash = stable_hash(std::to_string(options.shard_index) + "/" +
+                           std::to_string(options.shard_count),
+                       hash);
+
+    return hash;
+}
+
+Checkpointer::Checkpointer(const std::string &file, std::uint64_t fingerprint,
+                           std::chrono::seconds interval, const map_t &stats_map,
+                           CheckpointState state)
+    : file_(file),
+      fingerprint_(fingerprint),
+      interval_(interval),
+      stats_map_(stats_map),
+      resumed_(state.files.begin(), state.files.end()),
+      state_(std::move(state)),
+      thread_([this]() { run(); }) {}
+
+Checkpointer::~Checkpointer() {
+    {
+        const std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+
+    stop_cv_.notify_all();
+    thread_.join();
+}
+
+std::size_t Checkpointer::written() const {
+    const std::lock_guard<std::mutex> lock(state_mutex_);
+    return written_;
+}
+
+double Checkpointer::longest_pause() const {
+    const std::lock_guard<std::mutex> lock(state_mutex_);
+    return longest_pause_;
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+
+    while (!stop_cv_.wait_for(lock, interval_, [this]() { return stop_; })) {
+        lock.unlock();
+        write();
+        lock.lock();
+    }
+}
+
+void Checkpointer::write() {
+    std::vector<std::pair<PositionKey, Statistics>> entries;
+    CheckpointState state;
+
+    {
+        const std::unique_lock<std::shared_mutex> lock(merge_mutex_);
+        const auto t0 = std::chrono::steady_clock::now();
+
+        entries.reserve(stats_map_.size());
+
+        for (const auto &[key, stats] : stats_map_) entries.emplace_back(key, stats);
+
+        const std::lock_guard<std::mutex> state_lock(state_mutex_);
+        state = state_;
+
+        const std::chrono::duration<double> pause = std::chrono::steady_clock::now() - t0;
+        longest_pause_ = std::max(longest_pause_, pause.count());
+    }
+
+    const auto tmp = file_ + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+
+        os.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        write_pod(os, CHECKPOINT_VERSION);
+        write_pod(os, fingerprint_);
+        write_pod(os, state.games);
+        write_pod(os, static_cast<std::uint64_t>(state.files.size()));
+
+        for (const auto &file : state.files) write_string(os, file);
+
+        write_pod(os, static_cast<std::uint64_t>(entries.size()));
+
+        std::vector<PositionKey> raw;
+
+        for (const auto &[key, stats] : entries) {
+            write_pod(os, key);
+            write_pod(os, stats);
+
+            if (key.is_raw()) raw.push_back(key);
+        }
+
+        write_raw_fens(os, raw);
+
+        if (!os) {
+            std::cerr << "Warning: could not write the checkpoint " << file_ << std::endl;
+            return;
+        }
+    }
+
+    // the previous checkpoint stays until the new one is complete
+    std::error_code ec;
+    fs::rename(tmp, file_, ec);
+
+    if (ec) {
+        std::cerr << "Warning: could not write the checkpoint " << file_ << std::endl;
+        return;
+    }
+
+    const std::lock_guard<std::mutex> lock(state_mutex_);
+    written_++;
+}
+
+bool Checkpointer::load(const std::string &file, std::uint64_t fingerprint, map_t &stats_map,
+                        CheckpointState &state) {
+    std::ifstream is(file, std::ios::binary);
+
+    if (!is.is_open()) {
+        std::cerr << "Error: could not open the checkpoint " << file << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    std::uint32_t version       = 0;
+    std::uint64_t checkpoint_fp = 0, files = 0, count = 0;
+
+    if (!is.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || !read_pod(is, version) ||
+        version != CHECKPOINT_VERSION || !read_pod(is, checkpoint_fp)) {
+        std::cerr << "Error: " << file << " is not a checkpoint of this version" << std::endl;
+        return false;
+    }
+
+    if (checkpoint_fp != fingerprint) {
+        std::cerr << "Error: the checkpoint " << file
+                  << " was taken with other options, or of another directory" << std::endl;
+        return false;
+    }
+
+    const auto truncated = [&file]() {
+        std::cerr << "Error: the checkpoint " << file << " is truncated" << std::endl;
+        return false;
+    };
+
+    if (!read_pod(is, state.games) || !read_pod(is, files)) {
+        return truncated();
+    }
+
+    state.files.resize(files);
+
+    for (auto &path : state.files) {
+        if (!read_string(is, path)) return truncated();
+    }
+
+    if (!read_pod(is, count)) return truncated();
+
+    stats_map.reserve(stats_map.size() + count);
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        PositionKey key;
+        Statistics stats;
+
+        if (!read_pod(is, key) || !read_pod(is, stats)) return truncated();
+
+        stats_map[key] += stats;
+    }
+
+    if (!read_raw_fens(is)) return truncated();
+
+    return true;
+}
+
+void Checkpointer::remove(const std::string &file) {
+    std::error_code ec;
+
+    fs::remove(file, ec);
+    fs::remove(file + ".tmp", ec);
+}
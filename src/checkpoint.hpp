@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "./options.hpp"
+#include "./statistics.hpp"
+
+/// @brief The files covered by a checkpoint, and the games they added.
+struct CheckpointState {
+    // analysed completely, their statistics are in the map of the checkpoint
+    std::vector<std::string> files;
+
+    std::uint64_t games = 0;
+};
+
+/// @brief Everything that changes which files are analysed, or the statistics of a file.
+/// @param options
+/// @return
+[[nodiscard]] std::uint64_t checkpoint_fingerprint(const CLIOptions &options);
+
+/// @brief Writes the statistics of the finished files of a run to disk every interval, so that
+/// --resume continues from there once the run was killed. A file enters the checkpoint through
+/// complete(), with all of its statistics or none of them. Taking a checkpoint holds back the
+/// merges while the map is copied, the workers go on parsing, and the copy is written on the
+/// thread of the checkpoints.
+class Checkpointer {
+   public:
+    /// @param file
+    /// @param fingerprint of the options, a checkpoint of other options is not resumed
+    /// @param interval
+    /// @param stats_map only changed within complete() while the checkpoints are taken
+    /// @param state the files already in stats_map, from the checkpoint which was resumed
+    Checkpointer(const std::string &file, std::uint64_t fingerprint,
+                 std::chrono::seconds interval, const map_t &stats_map, CheckpointState state);
+
+    /// @brief Stops the thread, without taking another checkpoint.
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer &)            = delete;
+    Checkpointer &operator=(const Checkpointer &) = delete;
+
+    /// @brief Runs merge, which adds the statistics of a finished file to the map, and adds the
+    /// file to the next checkpoint. Any number of threads may merge at the same time.
+    /// @param file
+    /// @param games
+    /// @param merge
+    template <typename MERGE>
+    void complete(const std::string &file, std::size_t games, MERGE &&merge) {
+        const std::shared_lock<std::shared_mutex> lock(merge_mutex_);
+
+        merge();
+
+        const std::lock_guard<std::mutex> state_lock(state_mutex_);
+
+        state_.files.push_back(file);
+        state_.games += games;
+    }
+
+    /// @brief Whether the file was already analysed by the run which was resumed.
+    /// @param file
+    /// @return
+    [[nodiscard]] bool covers(const std::string &file) const {
+        return resumed_.find(file) != resumed_.end();
+    }
+
+    [[nodiscard]] std::size_t written() const;
+
+    /// @brief The longest time the merges were held back for a copy of the map.
+    [[nodiscard]] double longest_pause() const;
+
+    /// @brief Adds the statistics of a checkpoint to stats_map.
+    /// @param file
+    /// @param fingerprint
+    /// @param stats_map
+    /// @param state
+    /// @return false if the checkpoint is unreadable or was taken with other options
+    static bool load(const std::string &file, std::uint64_t fingerprint, map_t &stats_map,
+                     CheckpointState &state);
+
+    /// @brief Removes the checkpoint once the results are written.
+    /// @param file
+    static void remove(const std::string &file);
+
+   private:
+    void run();
+
+    void write();
+
+    std::string file_;
+    std::uint64_t fingerprint_;
+    std::chrono::seconds interval_;
+    const map_t &stats_map_;
+
+    std::unordered_set<std::string> resumed_;
+
+    // shared by the merges, held exclusively while the map is copied
+    std::shared_mutex merge_mutex_;
+
+    mutable std::mutex state_mutex_;
+    CheckpointState state_;
+    std::size_t written_  = 0;
+    double longest_pause_ = 0;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+
+    std::thread thread_;
+};
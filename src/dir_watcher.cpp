@@ -0,0 +1,109 @@
+#include "dir_watcher.hpp"
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#    define HAS_INOTIFY 1
+#endif
+
+namespace fs = std::filesystem;
+
+DirectoryWatcher::DirectoryWatcher(const std::string &dir) {
+#ifdef HAS_INOTIFY
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd_ < 0) return;
+
+    std::set<std::string> dirs;
+    watch_tree(dir, dirs);
+#else
+    (void)dir;
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+#ifdef HAS_INOTIFY
+    if (fd_ >= 0) close(fd_);
+#endif
+}
+
+void DirectoryWatcher::watch(const std::string &dir) {
+#ifdef HAS_INOTIFY
+    // a file is only complete once it is closed, or once it was moved into place
+    const int wd = inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+    if (wd >= 0) dirs_[wd] = dir;
+#else
+    (void)dir;
+#endif
+}
+
+void DirectoryWatcher::watch_tree(const std::string &dir, std::set<std::string> &dirs) {
+    watch(dir);
+    dirs.insert(dir);
+
+    std::error_code ec;
+
+    for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_directory(ec)) continue;
+
+        watch(it->path().string());
+        dirs.insert(it->path().string());
+    }
+}
+
+bool DirectoryWatcher::wait(std::chrono::milliseconds timeout, std::set<std::string> &dirs) {
+#ifdef HAS_INOTIFY
+    if (fd_ >= 0) {
+        pollfd pfd = {fd_, POLLIN, 0};
+
+        if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0) return false;
+
+        bool changed = false;
+
+        alignas(inotify_event) char buffer[1 << 14];
+        ssize_t length;
+
+        while ((length = read(fd_, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t pos = 0; pos < length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer + pos);
+                pos += sizeof(inotify_event) + event->len;
+
+                // events were lost, every directory is listed again
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (const auto &[wd, dir] : dirs_) dirs.insert(dir);
+
+                    changed = true;
+                    continue;
+                }
+
+                const auto it = dirs_.find(event->wd);
+
+                if (it == dirs_.end() || !event->len) continue;
+
+                // a directory which was moved in may already hold files and directories
+                if (event->mask & IN_ISDIR) {
+                    watch_tree((fs::path(it->second) / event->name).string(), dirs);
+                    changed = true;
+                } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    dirs.insert(it->second);
+                    changed = true;
+                }
+            }
+        }
+
+        return changed;
+    }
+#endif
+
+    (void)dirs;
+
+    std::this_thread::sleep_for(timeout);
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+/// @brief Wakes up --serve when a file below a directory is written or moved in, new
+/// subdirectories are watched as well. Uses inotify where it is available and reports the
+/// directories which changed, so that only those are listed again. Elsewhere wait() only
+/// sleeps, and the caller rescans the whole directory.
+class DirectoryWatcher {
+   public:
+    explicit DirectoryWatcher(const std::string &dir);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher &)            = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    /// @brief False if the directory is only polled.
+    [[nodiscard]] bool is_watching() const noexcept { return fd_ >= 0; }
+
+    /// @brief Waits for the next changes, all events which arrived meanwhile are consumed.
+    /// @param timeout
+    /// @param dirs the directories with new files are added, a new directory with every
+    /// directory below it, none if the directory is only polled
+    /// @return true if a file changed, false after the timeout
+    bool wait(std::chrono::milliseconds timeout, std::set<std::string> &dirs);
+
+   private:
+    void watch(const std::string &dir);
+
+    /// @brief Watches dir and every directory below it.
+    /// @param dir
+    /// @param dirs the directories are added to it
+    void watch_tree(const std::string &dir, std::set<std::string> &dirs);
+
+    int fd_ = -1;
+
+    // directory of each watch descriptor
+    std::unordered_map<int, std::string> dirs_;
+};
@@ -0,0 +1,190 @@
+#include "fen_normalizer.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./gz_reader.hpp"
+#include "./pgn_scanner.hpp"
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// reads the fields of an epd line the way operator>> reads them from a stream
+class FieldReader {
+   public:
+    FieldReader(std::string_view line) : line_(line) {}
+
+    std::string_view word() {
+        skip_spaces();
+
+        const auto start = pos_;
+        while (pos_ < line_.size() && !is_space(line_[pos_])) pos_++;
+
+        return line_.substr(start, pos_ - start);
+    }
+
+    bool integer(int &value) {
+        skip_spaces();
+
+        bool negative = false;
+
+        if (pos_ < line_.size() && (line_[pos_] == '+' || line_[pos_] == '-')) {
+            negative = line_[pos_++] == '-';
+        }
+
+        const auto start = pos_;
+        long long number = 0;
+
+        while (pos_ < line_.size() && line_[pos_] >= '0' && line_[pos_] <= '9') {
+            number = number * 10 + (line_[pos_++] - '0');
+            if (number > INT_MAX) return false;
+        }
+
+        if (pos_ == start) return false;
+
+        value = static_cast<int>(negative ? -number : number);
+        return true;
+    }
+
+   private:
+    void skip_spaces() {
+        while (pos_ < line_.size() && is_space(line_[pos_])) pos_++;
+    }
+
+    std::string_view line_;
+    std::size_t pos_ = 0;
+};
+
+void add_position(map_fens &fixfens, std::string_view position, std::pair<int, int> counters) {
+    const auto it = fixfens.find(position);
+
+    if (it == fixfens.end()) {
+        fixfens.emplace(std::string(position), counters);
+    } else if (counters.second < it->second.second) {
+        // for duplicate FENs, prefer the one with lower full move counter
+        it->second = counters;
+    }
+}
+
+void parse_lines(std::string_view text, map_fens &fixfens) {
+    std::string position;
+
+    while (!text.empty()) {
+        const auto nl   = text.find('\n');
+        const auto line = text.substr(0, nl);
+        text            = nl == std::string_view::npos ? std::string_view() : text.substr(nl + 1);
+
+        FieldReader reader(line);
+
+        const auto f1 = reader.word();
+        const auto f2 = reader.word();
+        const auto f3 = reader.word();
+        const auto ep = reader.word();
+
+        int halfmove = 0, fullmove = 0;
+
+        if (ep.empty() || !reader.integer(halfmove) || !reader.integer(fullmove) || !fullmove) {
+            continue;
+        }
+
+        position.assign(f1).append(" ").append(f2).append(" ").append(f3).append(" ").append(ep);
+
+        add_position(fixfens, position, {halfmove, fullmove});
+    }
+}
+
+}  // namespace
+
+std::optional<PositionKey> normalize_fen(std::string_view fen, const map_fens &fixfens,
+                                         bool &missing) {
+    missing = false;
+
+    // revert changes by cutechess-cli to move counters
+    const auto position = fixfens.empty() ? std::string_view() : strip_reset_counters(fen);
+
+    if (position.empty()) return pack_fen(fen);
+
+    const auto it = fixfens.find(position);
+
+    if (it == fixfens.end()) {
+        missing = true;
+        return std::nullopt;
+    }
+
+    auto key = PositionKey::from_fen(position);
+
+    if (key && key->set_counters(it->second.first, it->second.second)) return key;
+
+    // the text with the counters of the book, as it was written before the keys were packed
+    return PositionKey::from_raw_fen(std::string(position) + " " +
+                                     std::to_string(it->second.first) + " " +
+                                     std::to_string(it->second.second));
+}
+
+map_fens load_fixfens(const std::string &file, int concurrency) {
+    map_fens fixfens;
+
+    if (file.empty()) return fixfens;
+
+    std::string inflated;
+    std::unique_ptr<MappedFile> mapped;
+    std::string_view text;
+
+    if (file.size() >= 3 && file.substr(file.size() - 3) == ".gz") {
+        GzFileReader reader(file);
+
+        while (reader.is_open() && !reader.eof()) {
+            inflated.append(reader.next());
+        }
+
+        text = inflated;
+    } else {
+        mapped = std::make_unique<MappedFile>(file);
+        text   = mapped->view();
+    }
+
+    // each thread parses a range of whole lines, the ranges are merged in file order so that
+    // the first of several equal positions wins as before
+    const auto parts = static_cast<std::size_t>(std::max(1, concurrency));
+    std::vector<map_fens> partial(parts);
+    std::vector<std::thread> threads;
+
+    std::size_t begin = 0;
+
+    for (std::size_t i = 0; i < parts && begin < text.size(); i++) {
+        auto end = text.size();
+
+        if (i + 1 < parts) {
+            const auto nl = text.find('\n', std::max(begin, text.size() / parts * (i + 1)));
+            if (nl != std::string_view::npos) end = nl + 1;
+        }
+
+        const auto range = text.substr(begin, end - begin);
+        threads.emplace_back([range, &fixfens = partial[i]]() { parse_lines(range, fixfens); });
+
+        begin = end;
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    fixfens = std::move(partial[0]);
+
+    for (std::size_t i = 1; i < parts; i++) {
+        for (const auto &[position, counters] : partial[i]) {
+            add_position(fixfens, position, counters);
+        }
+    }
+
+    return fixfens;
+}
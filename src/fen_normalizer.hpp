@@ -0,0 +1,48 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "./options.hpp"
+#include "./position_key.hpp"
+
+/// @brief cutechess-cli writes the FEN of the opening position with the move counters
+/// reset to "0 1", this returns the FEN without them.
+/// @param fen
+/// @return empty if fen does not end in " 0 1"
+[[nodiscard]] inline std::string_view strip_reset_counters(std::string_view fen) noexcept {
+    constexpr std::string_view suffix = " 0 1";
+
+    if (fen.size() <= suffix.size() ||
+        fen.compare(fen.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return {};
+    }
+
+    return fen.substr(0, fen.size() - suffix.size());
+}
+
+/// @brief Packs a FEN, one which is not in the canonical form is kept as it is.
+/// @param fen
+/// @return
+[[nodiscard]] inline PositionKey pack_fen(std::string_view fen) {
+    if (const auto key = PositionKey::from_fen(fen)) return *key;
+
+    return PositionKey::from_raw_fen(fen);
+}
+
+/// @brief Packs the FEN of a game, with the move counters of the book position if cutechess-cli
+/// reset them. Without fixfens the FEN is packed as it is.
+/// @param fen
+/// @param fixfens
+/// @param missing set to true if the counters were reset but the position is not in fixfens
+/// @return std::nullopt if the position is missing
+[[nodiscard]] std::optional<PositionKey> normalize_fen(std::string_view fen,
+                                                       const map_fens &fixfens, bool &missing);
+
+/// @brief Reads the move counters of every position in an .epd or .epd.gz book, the lines are
+/// parsed on several threads. For duplicate positions the lower fullmove number is kept.
+/// @param file
+/// @param concurrency
+/// @return
+[[nodiscard]] map_fens load_fixfens(const std::string &file, int concurrency);
@@ -0,0 +1,258 @@
+#include "file_scan.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "./parallel.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// bump whenever the layout of the manifest changes
+constexpr std::uint32_t MANIFEST_VERSION = 1;
+constexpr char MANIFEST_MAGIC[8]         = {'A', 'N', 'A', 'F', 'I', 'L', 'E', 'S'};
+
+struct Directory {
+    std::int64_t mtime = 0;
+    std::vector<std::string> subdirs;
+    std::vector<ScannedFile> files;
+};
+
+using map_dirs = std::unordered_map<std::string, Directory>;
+
+// the same names as "*.pgn" and "*.pgn.gz" by stem() and extension(), without building them
+bool is_pgn(std::string_view name) {
+    const auto ends_with = [&](std::string_view suffix) {
+        return name.size() >= suffix.size() &&
+               name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    return ends_with(".pgn.gz") || (name.size() > 4 && ends_with(".pgn"));
+}
+
+std::int64_t mtime_of(const fs::file_time_type &time) { return time.time_since_epoch().count(); }
+
+Directory list_directory(const std::string &dir, std::int64_t mtime) {
+    Directory listing;
+    listing.mtime = mtime;
+
+    std::error_code ec;
+
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto &entry = *it;
+        std::error_code type_ec;
+
+        if (entry.is_regular_file(type_ec)) {
+            if (!is_pgn(entry.path().filename().native())) continue;
+
+            ScannedFile file;
+            file.path = entry.path().string();
+            file.test = test_of(file.path);
+
+            std::error_code info_ec;
+            file.info.size  = entry.file_size(info_ec);
+            file.info.valid = !info_ec;
+
+            if (file.info.valid) file.info.mtime = mtime_of(entry.last_write_time(info_ec));
+
+            file.info.valid = file.info.valid && !info_ec;
+
+            listing.files.push_back(std::move(file));
+        } else if (entry.is_directory(type_ec)) {
+            listing.subdirs.push_back(entry.path().string());
+        }
+    }
+
+    return listing;
+}
+
+map_dirs read_manifest(const std::string &manifest_file) {
+    map_dirs dirs;
+
+    std::ifstream is(manifest_file, std::ios::binary);
+    if (!is.is_open()) return dirs;
+
+    char magic[sizeof(MANIFEST_MAGIC)];
+    std::uint32_t version = 0;
+    std::uint64_t count   = 0;
+
+    if (!is.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) != 0 || !read_pod(is, version) ||
+        version != MANIFEST_VERSION || !read_pod(is, count)) {
+        return dirs;
+    }
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::string path;
+        Directory dir;
+        std::uint64_t subdirs = 0, files = 0;
+
+        if (!read_string(is, path) || !read_pod(is, dir.mtime) || !read_pod(is, subdirs)) {
+            return {};
+        }
+
+        dir.subdirs.resize(subdirs);
+
+        for (auto &subdir : dir.subdirs) {
+            if (!read_string(is, subdir)) return {};
+        }
+
+        if (!read_pod(is, files)) return {};
+
+        dir.files.resize(files);
+
+        for (auto &file : dir.files) {
+            if (!read_string(is, file.path) || !read_pod(is, file.info.size) ||
+                !read_pod(is, file.info.mtime) || !read_string(is, file.test.id)) {
+                return {};
+            }
+
+            file.info.valid = true;
+            file.test.path  = (fs::path(file.path).parent_path() / file.test.id).string();
+        }
+
+        dirs.emplace(std::move(path), std::move(dir));
+    }
+
+    return dirs;
+}
+
+void write_manifest(const std::string &manifest_file, const map_dirs &dirs) {
+    const auto tmp = manifest_file + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+
+        os.write(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+        write_pod(os, MANIFEST_VERSION);
+        write_pod(os, static_cast<std::uint64_t>(dirs.size()));
+
+        for (const auto &[path, dir] : dirs) {
+            write_string(os, path);
+            write_pod(os, dir.mtime);
+            write_pod(os, static_cast<std::uint64_t>(dir.subdirs.size()));
+
+            for (const auto &subdir : dir.subdirs) write_string(os, subdir);
+
+            // a file which could not be inspected is listed again next time
+            const auto valid = std::count_if(dir.files.begin(), dir.files.end(),
+                                             [](const auto &file) { return file.info.valid; });
+
+            write_pod(os, static_cast<std::uint64_t>(valid));
+
+            for (const auto &file : dir.files) {
+                if (!file.info.valid) continue;
+
+                write_string(os, file.path);
+                write_pod(os, file.info.size);
+                write_pod(os, file.info.mtime);
+                write_string(os, file.test.id);
+            }
+        }
+
+        if (!os) {
+            std::cerr << "Warning: could not write the manifest " << manifest_file << std::endl;
+            return;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, manifest_file, ec);
+
+    if (ec) {
+        std::cerr << "Warning: could not write the manifest " << manifest_file << std::endl;
+    }
+}
+}  // namespace
+
+FileScan scan_files(const std::string &dir, const std::string &manifest_file, int concurrency) {
+    const auto manifest = manifest_file.empty() ? map_dirs() : read_manifest(manifest_file);
+
+    FileScan scan;
+    map_dirs dirs;
+
+    // a directory which changed just now may change again within the same tick of a coarse
+    // clock, its time is not kept, so that it is listed again by the next run
+    const auto racy = fs::file_time_type::clock::now() - std::chrono::seconds(2);
+
+    // directories wait here until a thread lists them, a listing adds the subdirectories
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> pending = {dir};
+    std::size_t active               = 0;
+
+    run_threads(std::max(1, concurrency), [&](std::size_t) {
+        while (true) {
+            std::string current;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return !pending.empty() || active == 0; });
+
+                // nothing is left and no listing can add more
+                if (pending.empty()) return;
+
+                current = std::move(pending.back());
+                pending.pop_back();
+                active++;
+            }
+
+            std::error_code ec;
+            const auto mtime = fs::last_write_time(current, ec);
+
+            // adding or removing an entry changes the time of the directory
+            const auto it     = ec ? manifest.end() : manifest.find(current);
+            const bool reused = it != manifest.end() && it->second.mtime == mtime_of(mtime);
+
+            const auto kept = ec || mtime > racy ? 0 : mtime_of(mtime);
+            auto listing    = reused ? it->second : list_directory(current, kept);
+
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+
+                pending.insert(pending.end(), listing.subdirs.begin(), listing.subdirs.end());
+                (reused ? scan.reused_dirs : scan.listed_dirs)++;
+
+                dirs[current] = std::move(listing);
+                active--;
+            }
+
+            cv.notify_all();
+        }
+    });
+
+    for (const auto &[path, listing] : dirs) {
+        scan.files.insert(scan.files.end(), listing.files.begin(), listing.files.end());
+    }
+
+    std::sort(scan.files.begin(), scan.files.end(),
+              [](const auto &a, const auto &b) { return a.path < b.path; });
+
+    // unchanged directories only need an update if one of them disappeared
+    if (!manifest_file.empty() && (scan.listed_dirs > 0 || dirs.size() != manifest.size())) {
+        write_manifest(manifest_file, dirs);
+    }
+
+    return scan;
+}
+
+std::vector<ScannedFile> list_files(const std::string &dir) {
+    auto files = list_directory(dir, 0).files;
+
+    std::sort(files.begin(), files.end(),
+              [](const auto &a, const auto &b) { return a.path < b.path; });
+
+    return files;
+}
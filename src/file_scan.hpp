@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "./binary_io.hpp"
+#include "./metadata.hpp"
+
+/// @brief A .pgn or .pgn.gz file found below --dir.
+struct ScannedFile {
+    std::string path;
+
+    // size and modification time when its directory was listed
+    FileInfo info;
+
+    TestFile test;
+};
+
+struct FileScan {
+    // sorted by path
+    std::vector<ScannedFile> files;
+
+    std::size_t listed_dirs = 0;
+    std::size_t reused_dirs = 0;
+};
+
+/// @brief Finds the pgn files below dir, the subdirectories are listed on several threads.
+/// With a manifest, a directory whose modification time is the one in the manifest is not
+/// listed again, its files and subdirectories are taken from the manifest. A file which is
+/// appended to in place does not change its directory, it keeps the size of the manifest
+/// then. The manifest is rewritten with the current state of every directory.
+/// @param dir
+/// @param manifest_file empty to list every directory
+/// @param concurrency
+/// @return
+[[nodiscard]] FileScan scan_files(const std::string &dir, const std::string &manifest_file,
+                                  int concurrency);
+
+/// @brief The pgn files directly in dir, without its subdirectories and always listed.
+/// @param dir
+/// @return sorted by path
+[[nodiscard]] std::vector<ScannedFile> list_files(const std::string &dir);
@@ -0,0 +1,368 @@
+#include "game_filter.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+// the state of a game keeps one bit per leaf, per header and per term
+constexpr std::size_t MAX_ITEMS = 64;
+
+bool parse_number(std::string_view text, double &number) {
+    char buffer[32];
+
+    if (text.empty() || text.size() >= sizeof(buffer)) return false;
+
+    std::memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+
+    char *end = nullptr;
+    number    = std::strtod(buffer, &end);
+
+    return end == buffer + text.size();
+}
+}  // namespace
+
+/// @brief Recursive descent parser, the tree only lives until it is flattened into terms.
+///
+///   or      := and ("||" and)*
+///   and     := unary ("&&" unary)*
+///   unary   := "!" unary | "(" or ")" | Header op literal | Header "in" "(" literal, ... ")"
+///   op      := "==" | "!=" | "<" | "<=" | ">" | ">=" | "~"
+///   literal := "string" | number
+class FilterParser {
+   public:
+    FilterParser(GameFilter &filter, const std::string &text) : filter_(filter), text_(text) {}
+
+    void parse() {
+        auto root = parse_or();
+
+        skip_space();
+        if (pos_ != text_.size()) fail("unexpected input");
+
+        // every top level && term can reject the game on its own
+        std::vector<const Node *> terms;
+        collect_terms(*root, terms);
+
+        if (terms.size() > MAX_ITEMS) fail("too many top level && terms");
+
+        for (const auto *node : terms) {
+            GameFilter::Term term{{}, 0};
+            flatten(*node, term);
+            filter_.terms_.push_back(std::move(term));
+        }
+    }
+
+   private:
+    struct Node {
+        GameFilter::Code code;
+        std::size_t leaf = 0;
+        std::unique_ptr<Node> left, right;
+    };
+
+    using NodePtr = std::unique_ptr<Node>;
+
+    static NodePtr make(GameFilter::Code code, NodePtr left, NodePtr right = nullptr) {
+        auto node   = std::make_unique<Node>();
+        node->code  = code;
+        node->left  = std::move(left);
+        node->right = std::move(right);
+        return node;
+    }
+
+    [[noreturn]] void fail(const std::string &message) const {
+        throw std::invalid_argument("--filter: " + message + " at position " +
+                                    std::to_string(pos_) + " of \"" + text_ + "\"");
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            pos_++;
+        }
+    }
+
+    bool accept(std::string_view token) {
+        skip_space();
+
+        if (text_.compare(pos_, token.size(), token) != 0) return false;
+
+        pos_ += token.size();
+        return true;
+    }
+
+    void expect(std::string_view token) {
+        if (!accept(token)) fail("expected \"" + std::string(token) + "\"");
+    }
+
+    std::string identifier() {
+        skip_space();
+
+        const auto start = pos_;
+
+        while (pos_ < text_.size() &&
+               (std::isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_')) {
+            pos_++;
+        }
+
+        if (start == pos_) fail("expected a header name");
+
+        return text_.substr(start, pos_ - start);
+    }
+
+    NodePtr parse_or() {
+        auto left = parse_and();
+
+        while (accept("||")) {
+            left = make(GameFilter::Code::Or, std::move(left), parse_and());
+        }
+
+        return left;
+    }
+
+    NodePtr parse_and() {
+        auto left = parse_unary();
+
+        while (accept("&&")) {
+            left = make(GameFilter::Code::And, std::move(left), parse_unary());
+        }
+
+        return left;
+    }
+
+    NodePtr parse_unary() {
+        // "!=" never starts a unary expression, so a single "!" is a negation
+        if (accept("!")) return make(GameFilter::Code::Not, parse_unary());
+
+        if (accept("(")) {
+            auto inner = parse_or();
+            expect(")");
+            return inner;
+        }
+
+        const auto header = header_index(identifier());
+
+        if (accept("in")) {
+            expect("(");
+
+            // an allow-list is a chain of equality tests
+            NodePtr list = leaf(header, GameFilter::Op::Equal);
+
+            while (accept(",")) {
+                auto next = leaf(header, GameFilter::Op::Equal);
+                list      = make(GameFilter::Code::Or, std::move(list), std::move(next));
+            }
+
+            expect(")");
+            return list;
+        }
+
+        return leaf(header, parse_op());
+    }
+
+    GameFilter::Op parse_op() {
+        using Op = GameFilter::Op;
+
+        // the two character operators first, "<=" must not be read as "<"
+        if (accept("==")) return Op::Equal;
+        if (accept("!=")) return Op::NotEqual;
+        if (accept("<=")) return Op::LessEqual;
+        if (accept(">=")) return Op::GreaterEqual;
+        if (accept("<")) return Op::Less;
+        if (accept(">")) return Op::Greater;
+        if (accept("~")) return Op::Contains;
+
+        fail("expected a comparison");
+    }
+
+    NodePtr leaf(std::size_t header, GameFilter::Op op) {
+        GameFilter::Leaf leaf{header, op, {}, false, 0};
+
+        skip_space();
+
+        if (pos_ < text_.size() && text_[pos_] == '"') {
+            const auto end = text_.find('"', pos_ + 1);
+
+            if (end == std::string::npos) fail("unterminated string");
+
+            leaf.text = text_.substr(pos_ + 1, end - pos_ - 1);
+            pos_      = end + 1;
+        } else {
+            const auto start = pos_;
+
+            while (pos_ < text_.size() && (std::isdigit(static_cast<unsigned char>(text_[pos_])) ||
+                                           std::strchr("+-.eE", text_[pos_]))) {
+                pos_++;
+            }
+
+            leaf.text    = text_.substr(start, pos_ - start);
+            leaf.numeric = parse_number(leaf.text, leaf.number);
+
+            if (!leaf.numeric) fail("expected a string or a number");
+        }
+
+        if (op == GameFilter::Op::Contains && leaf.numeric) fail("~ expects a string");
+
+        if (filter_.leaves_.size() == MAX_ITEMS) fail("too many comparisons");
+
+        auto node  = make(GameFilter::Code::Leaf, nullptr);
+        node->leaf = filter_.leaves_.size();
+
+        filter_.leaves_.push_back(std::move(leaf));
+
+        return node;
+    }
+
+    std::size_t header_index(const std::string &name) {
+        for (std::size_t i = 0; i < filter_.headers_.size(); i++) {
+            if (filter_.headers_[i] == name) return i;
+        }
+
+        if (filter_.headers_.size() == MAX_ITEMS) fail("too many headers");
+
+        filter_.headers_.push_back(name);
+        return filter_.headers_.size() - 1;
+    }
+
+    void collect_terms(const Node &node, std::vector<const Node *> &terms) const {
+        if (node.code == GameFilter::Code::And) {
+            collect_terms(*node.left, terms);
+            collect_terms(*node.right, terms);
+        } else {
+            terms.push_back(&node);
+        }
+    }
+
+    void flatten(const Node &node, GameFilter::Term &term) const {
+        if (node.left) flatten(*node.left, term);
+        if (node.right) flatten(*node.right, term);
+
+        if (node.code == GameFilter::Code::Leaf) {
+            term.headers |= std::uint64_t(1) << filter_.leaves_[node.leaf].header;
+        }
+
+        term.program.push_back({node.code, static_cast<std::uint8_t>(node.leaf)});
+    }
+
+    GameFilter &filter_;
+    const std::string &text_;
+    std::size_t pos_ = 0;
+};
+
+GameFilter::GameFilter(const std::string &expression) : source_(expression) {
+    FilterParser(*this, expression).parse();
+
+    for (std::size_t i = 0; i < leaves_.size(); i++) {
+        if (compare(leaves_[i], "")) missing_ |= std::uint64_t(1) << i;
+    }
+}
+
+bool GameFilter::header(State &state, std::string_view key, std::string_view value) const {
+    std::size_t header = 0;
+
+    while (header < headers_.size() && headers_[header] != key) header++;
+
+    if (header == headers_.size()) return true;
+
+    for (std::size_t i = 0; i < leaves_.size(); i++) {
+        if (leaves_[i].header != header) continue;
+
+        const auto bit = std::uint64_t(1) << i;
+        state.results  = compare(leaves_[i], value) ? state.results | bit : state.results & ~bit;
+    }
+
+    state.seen |= std::uint64_t(1) << header;
+
+    // the terms whose headers are all known now
+    for (std::size_t t = 0; t < terms_.size(); t++) {
+        const auto bit = std::uint64_t(1) << t;
+
+        if ((state.done & bit) || (terms_[t].headers & ~state.seen)) continue;
+
+        state.done |= bit;
+
+        if (!run(terms_[t], state.results)) return false;
+    }
+
+    return true;
+}
+
+bool GameFilter::finish(State &state) const {
+    for (std::size_t t = 0; t < terms_.size(); t++) {
+        const auto bit = std::uint64_t(1) << t;
+
+        if (state.done & bit) continue;
+
+        state.done |= bit;
+
+        if (!run(terms_[t], state.results)) return false;
+    }
+
+    return true;
+}
+
+bool GameFilter::compare(const Leaf &leaf, std::string_view value) const {
+    if (leaf.op == Op::Contains) return value.find(leaf.text) != std::string_view::npos;
+
+    int order = 0;
+
+    if (leaf.numeric) {
+        double number = 0;
+
+        // a value which is no number, e.g. "?" or a missing header, is only ever unequal
+        if (!parse_number(value, number)) return leaf.op == Op::NotEqual;
+
+        order = number < leaf.number ? -1 : number > leaf.number ? 1 : 0;
+    } else {
+        order = value.compare(leaf.text);
+    }
+
+    switch (leaf.op) {
+        case Op::Equal:
+            return order == 0;
+        case Op::NotEqual:
+            return order != 0;
+        case Op::Less:
+            return order < 0;
+        case Op::LessEqual:
+            return order <= 0;
+        case Op::Greater:
+            return order > 0;
+        case Op::GreaterEqual:
+            return order >= 0;
+        default:
+            return false;
+    }
+}
+
+bool GameFilter::run(const Term &term, std::uint64_t results) const {
+    // a post-order program of at most 64 leaves never holds more than 64 values
+    bool stack[MAX_ITEMS];
+    std::size_t size = 0;
+
+    for (const auto &instruction : term.program) {
+        switch (instruction.code) {
+            case Code::Leaf:
+                stack[size++] = (results >> instruction.leaf) & 1;
+                break;
+            case Code::Not:
+                stack[size - 1] = !stack[size - 1];
+                break;
+            case Code::And:
+                size--;
+                stack[size - 1] = stack[size - 1] && stack[size];
+                break;
+            case Code::Or:
+                size--;
+                stack[size - 1] = stack[size - 1] || stack[size];
+                break;
+        }
+    }
+
+    return stack[0];
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Per game filter of --filter, e.g.
+///
+///   WhiteElo >= 3000 && TimeControl == "60+0.6" && !(White ~ "dev") &&
+///   Termination in ("adjudication", "")
+///
+/// Every comparison refers to one header and is evaluated as soon as that header is read, a
+/// missing header compares as "". A number literal compares numerically, a string literal
+/// lexicographically, ~ tests for a substring. The expression is compiled once into a flat
+/// program per top level && term, and a term runs as soon as the headers it refers to are
+/// known, so that a game is rejected at the earliest header possible.
+class GameFilter {
+   public:
+    /// @brief Per game state, reset with start() for every game.
+    struct State {
+        std::uint64_t results = 0;
+        std::uint64_t seen    = 0;
+        std::uint64_t done    = 0;
+    };
+
+    GameFilter() = default;
+
+    /// @brief Compiles the expression, throws std::invalid_argument on a syntax error.
+    /// @param expression
+    explicit GameFilter(const std::string &expression);
+
+    /// @brief True if no expression was given, every game passes then.
+    [[nodiscard]] bool empty() const noexcept { return terms_.empty(); }
+
+    [[nodiscard]] const std::string &source() const noexcept { return source_; }
+
+    void start(State &state) const noexcept {
+        state.results = missing_;
+        state.seen    = 0;
+        state.done    = 0;
+    }
+
+    /// @brief Feeds a header of the game.
+    /// @param state
+    /// @param key
+    /// @param value
+    /// @return false as soon as the game is known to fail
+    bool header(State &state, std::string_view key, std::string_view value) const;
+
+    /// @brief Runs the terms left after the last header, their missing headers are "".
+    /// @param state
+    /// @return true if the game passes
+    [[nodiscard]] bool finish(State &state) const;
+
+   private:
+    enum class Op : std::uint8_t {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Contains,
+    };
+
+    // a comparison of one header with a literal
+    struct Leaf {
+        std::size_t header;
+        Op op;
+        std::string text;
+        bool numeric;
+        double number;
+    };
+
+    // post-order program, a Leaf instruction pushes the result of a leaf
+    enum class Code : std::uint8_t { Leaf, Not, And, Or };
+
+    struct Instruction {
+        Code code;
+        std::uint8_t leaf;
+    };
+
+    struct Term {
+        std::vector<Instruction> program;
+
+        // bit set of the headers the term refers to
+        std::uint64_t headers;
+    };
+
+    friend class FilterParser;
+
+    [[nodiscard]] bool compare(const Leaf &leaf, std::string_view value) const;
+    [[nodiscard]] bool run(const Term &term, std::uint64_t results) const;
+
+    std::string source_;
+    std::vector<std::string> headers_;
+    std::vector<Leaf> leaves_;
+    std::vector<Term> terms_;
+
+    // the result of every leaf for a header which is missing
+    std::uint64_t missing_ = 0;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string_view>
+
+#include "./statistics.hpp"
+
+/// @brief The headers of a game the analysis reads, every other header is ignored.
+enum class HeaderKey { OTHER, RESULT, FEN, TIME_CONTROL, TERMINATION };
+
+/// @brief Matches a header key by its length first, so that most keys which are not read are
+/// told apart from the ones which are without looking at their characters.
+/// @param key
+/// @return
+[[nodiscard]] constexpr HeaderKey header_key(std::string_view key) noexcept {
+    switch (key.size()) {
+        case 3:
+            return key == "FEN" ? HeaderKey::FEN : HeaderKey::OTHER;
+        case 6:
+            return key == "Result" ? HeaderKey::RESULT : HeaderKey::OTHER;
+        case 11:
+            if (key[1] == 'i') {
+                return key == "TimeControl" ? HeaderKey::TIME_CONTROL : HeaderKey::OTHER;
+            }
+
+            return key == "Termination" ? HeaderKey::TERMINATION : HeaderKey::OTHER;
+        default:
+            return HeaderKey::OTHER;
+    }
+}
+
+/// @brief The value of a Result header.
+/// @param value
+/// @return Result::UNKNOWN for "*" and anything else which is not a result
+[[nodiscard]] constexpr Result parse_result(std::string_view value) noexcept {
+    switch (value.size()) {
+        case 3:
+            if (value == "1-0") return Result::WIN;
+
+            return value == "0-1" ? Result::LOSS : Result::UNKNOWN;
+        case 7:
+            return value == "1/2-1/2" ? Result::DRAW : Result::UNKNOWN;
+        default:
+            return Result::UNKNOWN;
+    }
+}
+
+/// @brief Whether a Termination of cutechess-cli means that the game was not played out, the
+/// result of such a game is not counted.
+/// @param value
+/// @return
+[[nodiscard]] constexpr bool aborted_termination(std::string_view value) noexcept {
+    switch (value.size()) {
+        case 9:
+            return value == "abandoned";
+        case 12:
+            // adjudication, the most frequent value, has the same length
+            switch (value[0]) {
+                case 't':
+                    return value == "time forfeit";
+                case 'i':
+                    return value == "illegal move";
+                case 'u':
+                    return value == "unterminated";
+                default:
+                    return false;
+            }
+        case 18:
+            return value == "stalled connection";
+        default:
+            return false;
+    }
+}
+
+static_assert(header_key("TimeControl") == HeaderKey::TIME_CONTROL &&
+                  header_key("Termination") == HeaderKey::TERMINATION &&
+                  header_key("TimeControls") == HeaderKey::OTHER &&
+                  header_key("ECO") == HeaderKey::OTHER,
+              "a header key was matched wrongly");
+static_assert(parse_result("1/2-1/2") == Result::DRAW && parse_result("0-1") == Result::LOSS &&
+                  parse_result("*") == Result::UNKNOWN,
+              "a result was matched wrongly");
+static_assert(aborted_termination("time forfeit") && aborted_termination("stalled connection") &&
+                  !aborted_termination("adjudication") && !aborted_termination("normal"),
+              "a termination was matched wrongly");
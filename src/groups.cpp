@@ -0,0 +1,116 @@
+#include "groups.hpp"
+
+#include <cctype>
+#include <sstream>
+
+namespace {
+// keeps a value usable as part of a file name
+std::string sanitize(std::string_view value) {
+    std::string name;
+
+    for (const char c : value) {
+        const bool safe = std::isalnum(static_cast<unsigned char>(c)) || c == '+' || c == '-' ||
+                          c == '.' || c == '_';
+        name += safe ? c : '_';
+    }
+
+    return name.empty() ? "_" : name;
+}
+}  // namespace
+
+std::optional<std::vector<GroupDimension>> parse_group_by(const std::string &spec) {
+    std::vector<GroupDimension> dimensions;
+    std::stringstream ss(spec);
+    std::string name;
+
+    while (std::getline(ss, name, ',')) {
+        if (name == "book") {
+            dimensions.push_back(GroupDimension::Book);
+        } else if (name == "book_depth") {
+            dimensions.push_back(GroupDimension::BookDepth);
+        } else if (name == "sprt") {
+            dimensions.push_back(GroupDimension::Sprt);
+        } else if (name == "test") {
+            dimensions.push_back(GroupDimension::Test);
+        } else if (name == "tc") {
+            dimensions.push_back(GroupDimension::TimeControl);
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (dimensions.empty()) return std::nullopt;
+
+    return dimensions;
+}
+
+bool groups_per_game(const std::vector<GroupDimension> &dimensions) {
+    for (const auto dimension : dimensions) {
+        if (dimension == GroupDimension::TimeControl) return true;
+    }
+
+    return false;
+}
+
+std::string test_group(const std::vector<GroupDimension> &dimensions, const TestFile &test,
+                       const map_meta &meta_map) {
+    const auto it            = meta_map.find(test.path);
+    const TestMetaData *meta = it != meta_map.end() ? &it->second : nullptr;
+
+    std::string group;
+
+    for (const auto dimension : dimensions) {
+        std::string value;
+
+        switch (dimension) {
+            case GroupDimension::Book:
+                value = meta && meta->book ? sanitize(*meta->book) : "nobook";
+                break;
+            case GroupDimension::BookDepth:
+                value = meta && meta->book_depth ? "depth" + std::to_string(*meta->book_depth)
+                                                 : "nodepth";
+                break;
+            case GroupDimension::Sprt:
+                value = meta && meta->sprt.value_or(false) ? "sprt" : "nosprt";
+                break;
+            case GroupDimension::Test:
+                value = sanitize(test.id);
+                break;
+            case GroupDimension::TimeControl:
+                // read from the games, see game_group
+                continue;
+        }
+
+        group += (group.empty() ? "" : "_") + value;
+    }
+
+    return group;
+}
+
+std::string game_group(const std::string &group, std::string_view value) {
+    const auto name = value.empty() ? std::string("notc") : sanitize(value);
+    return group.empty() ? name : group + "_" + name;
+}
+
+map_t &GroupMaps::get(const std::string &group) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    auto &stats_map = maps_[group];
+
+    if (!stats_map) stats_map = std::make_unique<map_t>();
+
+    return *stats_map;
+}
+
+std::vector<std::pair<std::string, map_t *>> GroupMaps::all() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<std::string, map_t *>> result;
+
+    // files grouped per game still ask for the map of their test, which may stay empty
+    for (auto &[group, stats_map] : maps_) {
+        if (!stats_map->empty()) result.emplace_back(group, stats_map.get());
+    }
+
+    return result;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./metadata.hpp"
+#include "./options.hpp"
+#include "./statistics.hpp"
+
+/// @brief Parses the argument of --groupBy, a comma separated list of book, book_depth, sprt,
+/// test and tc.
+/// @param spec
+/// @return std::nullopt if a dimension is unknown
+[[nodiscard]] std::optional<std::vector<GroupDimension>> parse_group_by(const std::string &spec);
+
+/// @brief True if a dimension is read from the games, so that a file can contribute to
+/// several groups.
+[[nodiscard]] bool groups_per_game(const std::vector<GroupDimension> &dimensions);
+
+/// @brief The part of the group name which is the same for every game of a test, the values
+/// of the metadata dimensions joined by '_', e.g. "UHO_Lichess_4852_v1.epd_sprt".
+/// @param dimensions
+/// @param test
+/// @param meta_map
+/// @return
+[[nodiscard]] std::string test_group(const std::vector<GroupDimension> &dimensions,
+                                     const TestFile &test, const map_meta &meta_map);
+
+/// @brief Adds the value of a game header to a group name, the time control always comes
+/// after the metadata dimensions.
+/// @param group
+/// @param value
+/// @return
+[[nodiscard]] std::string game_group(const std::string &group, std::string_view value);
+
+/// @brief One map per group, group names are only used in file names, so they are made up of
+/// letters, digits and "+-._" only.
+class GroupMaps {
+   public:
+    /// @brief Sets the group of a file, all files are assigned before the analysis starts.
+    /// @param file
+    /// @param group
+    void assign(const std::string &file, std::string group) { files_[file] = std::move(group); }
+
+    /// @brief Group of a file given to assign().
+    [[nodiscard]] const std::string &group_of(const std::string &file) const {
+        return files_.at(file);
+    }
+
+    /// @brief The map of a group, it is created on first use. Safe to call from any thread.
+    /// @param group
+    /// @return stays valid as long as the GroupMaps
+    [[nodiscard]] map_t &get(const std::string &group);
+
+    /// @brief All groups which received a game, or a cached result, ordered by name.
+    [[nodiscard]] std::vector<std::pair<std::string, map_t *>> all();
+
+   private:
+    std::unordered_map<std::string, std::string> files_;
+
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<map_t>> maps_;
+};
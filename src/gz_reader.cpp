@@ -0,0 +1,168 @@
+#include "gz_reader.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+GzDecoder::GzDecoder() {
+    // 15 window bits, +32 detects the gzip (or zlib) header automatically
+    if (inflateInit2(&strm_, 15 + 32) != Z_OK) {
+        throw std::runtime_error("Could not initialize zlib");
+    }
+
+    initialized_ = true;
+}
+
+GzDecoder::~GzDecoder() {
+    if (initialized_) inflateEnd(&strm_);
+}
+
+void GzDecoder::set_input(std::string_view in) {
+    strm_.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    strm_.avail_in = static_cast<uInt>(in.size());
+}
+
+void GzDecoder::reset() {
+    inflateReset(&strm_);
+
+    strm_.next_in  = nullptr;
+    strm_.avail_in = 0;
+    member_end_    = false;
+    input_end_     = false;
+    finished_      = false;
+    started_       = false;
+    plain_         = false;
+}
+
+std::size_t GzDecoder::decode(char *out, std::size_t size) {
+    strm_.next_out  = reinterpret_cast<Bytef *>(out);
+    strm_.avail_out = static_cast<uInt>(size);
+
+    while (strm_.avail_out > 0 && !finished_) {
+        if (strm_.avail_in == 0) {
+            // a truncated member ends the data silently, as with gzread
+            if (input_end_) finished_ = true;
+            break;
+        }
+
+        // a .gz file which is not compressed at all is read like igzstream did
+        if (!started_) {
+            started_ = true;
+            plain_   = strm_.next_in[0] != 0x1f;
+        }
+
+        if (plain_) {
+            const auto bytes = std::min(strm_.avail_in, strm_.avail_out);
+            std::memcpy(strm_.next_out, strm_.next_in, bytes);
+
+            strm_.next_in += bytes;
+            strm_.avail_in -= bytes;
+            strm_.next_out += bytes;
+            strm_.avail_out -= bytes;
+            continue;
+        }
+
+        if (member_end_) {
+            // only another gzip member may follow, anything else is ignored
+            if (strm_.next_in[0] != 0x1f) {
+                finished_ = true;
+                break;
+            }
+
+            inflateReset(&strm_);
+            member_end_ = false;
+        }
+
+        const int ret = inflate(&strm_, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END) {
+            member_end_ = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw std::runtime_error(std::string("zlib inflate failed: ") +
+                                     (strm_.msg ? strm_.msg : std::to_string(ret)));
+        }
+    }
+
+    return size - strm_.avail_out;
+}
+
+bool GzFileReader::open(const std::string &path) {
+    close();
+
+    // a buffer which grew for a large game stays large
+    if (input_.size() < INPUT_SIZE) input_.resize(INPUT_SIZE);
+    if (output_.size() < OUTPUT_SIZE) output_.resize(OUTPUT_SIZE);
+
+    decoder_.reset();
+    filled_           = 0;
+    eof_              = false;
+    compressed_bytes_ = 0;
+    read_time_        = {};
+
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_) std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    return file_ != nullptr;
+}
+
+void GzFileReader::close() noexcept {
+    if (file_) std::fclose(file_);
+    file_ = nullptr;
+}
+
+std::string_view GzFileReader::next(std::size_t keep) {
+    if (!file_) {
+        eof_ = true;
+        return {};
+    }
+
+    keep = std::min(keep, filled_);
+
+    if (keep) std::memmove(output_.data(), output_.data() + filled_ - keep, keep);
+
+    // a single unfinished record should never fill the whole buffer
+    if (keep > output_.size() / 2) output_.resize(output_.size() * 2);
+
+    filled_ = keep;
+
+    while (filled_ < output_.size() && !decoder_.finished()) {
+        if (decoder_.needs_input()) {
+            const auto t0    = std::chrono::steady_clock::now();
+            const auto bytes = std::fread(input_.data(), 1, input_.size(), file_);
+
+            read_time_ += std::chrono::steady_clock::now() - t0;
+            compressed_bytes_ += bytes;
+
+            if (bytes == 0) {
+                decoder_.set_input_end();
+            } else {
+                decoder_.set_input({input_.data(), bytes});
+            }
+        }
+
+        filled_ += decoder_.decode(output_.data() + filled_, output_.size() - filled_);
+    }
+
+    eof_ = decoder_.finished();
+
+    return {output_.data(), filled_};
+}
+
+GzStreamBuf::int_type GzStreamBuf::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    if (reader_.eof()) return traits_type::eof();
+
+    const auto chunk = reader_.next();
+
+    if (chunk.empty()) return traits_type::eof();
+
+    auto *begin = const_cast<char *>(chunk.data());
+    setg(begin, begin, begin + chunk.size());
+
+    return traits_type::to_int_type(*gptr());
+}
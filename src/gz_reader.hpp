@@ -0,0 +1,135 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Incremental inflate of gzip data, concatenated members are decoded as one stream.
+/// Like gzread, trailing bytes after a member which do not start another member are ignored,
+/// and data which does not start with a gzip header is passed through as it is.
+class GzDecoder {
+   public:
+    GzDecoder();
+    ~GzDecoder();
+
+    GzDecoder(const GzDecoder &)            = delete;
+    GzDecoder &operator=(const GzDecoder &) = delete;
+
+    /// @brief Sets the next block of compressed data, the previous one has to be consumed.
+    /// The data has to stay valid until it is consumed.
+    /// @param in
+    void set_input(std::string_view in);
+
+    [[nodiscard]] bool needs_input() const noexcept { return !finished_ && strm_.avail_in == 0; }
+
+    /// @brief True once the end of the last member was reached.
+    [[nodiscard]] bool finished() const noexcept { return finished_; }
+
+    /// @brief Decompresses into out, throws std::runtime_error on corrupt data.
+    /// @param out
+    /// @param size
+    /// @return number of bytes written
+    std::size_t decode(char *out, std::size_t size);
+
+    /// @brief Marks the compressed input as complete.
+    void set_input_end() noexcept { input_end_ = true; }
+
+    /// @brief Prepares the decoder for another stream, the memory of zlib is kept.
+    void reset();
+
+   private:
+    z_stream strm_    = {};
+    bool member_end_  = false;
+    bool input_end_   = false;
+    bool finished_    = false;
+    bool initialized_ = false;
+
+    // decided by the first byte of the stream
+    bool started_ = false;
+    bool plain_   = false;
+};
+
+/// @brief Reads a gzip file in large chunks of decompressed data.
+class GzFileReader {
+   public:
+    static constexpr std::size_t INPUT_SIZE  = 1 << 20;
+    static constexpr std::size_t OUTPUT_SIZE = 1 << 22;
+
+    GzFileReader() = default;
+    GzFileReader(const std::string &path) { open(path); }
+    ~GzFileReader() { close(); }
+
+    GzFileReader(const GzFileReader &)            = delete;
+    GzFileReader &operator=(const GzFileReader &) = delete;
+
+    /// @brief Starts reading another file. The buffers and the decoder of the previous file
+    /// are reused, so a reader which is kept for many files allocates only once.
+    /// @param path
+    /// @return false if the file could not be opened
+    bool open(const std::string &path);
+
+    void close() noexcept;
+
+    [[nodiscard]] bool is_open() const noexcept { return file_ != nullptr; }
+
+    /// @brief Decompresses the next chunk. The last keep bytes of the previous chunk are
+    /// moved to the front of the new one, the buffer grows if they would not leave room.
+    /// @param keep
+    /// @return view which stays valid until the next call
+    [[nodiscard]] std::string_view next(std::size_t keep = 0);
+
+    /// @brief True if the chunk returned last was the final one.
+    [[nodiscard]] bool eof() const noexcept { return eof_; }
+
+    /// @brief Compressed bytes read from the file so far.
+    [[nodiscard]] std::uint64_t compressed_bytes() const noexcept { return compressed_bytes_; }
+
+    /// @brief Part of the time spent in next() which went into reading the file.
+    [[nodiscard]] double read_seconds() const noexcept { return read_time_.count(); }
+
+   private:
+    std::FILE *file_ = nullptr;
+    GzDecoder decoder_;
+    std::vector<char> input_;
+    std::vector<char> output_;
+    std::size_t filled_ = 0;
+    bool eof_           = false;
+
+    std::uint64_t compressed_bytes_ = 0;
+    std::chrono::duration<double> read_time_{0};
+};
+
+class GzStreamBuf : public std::streambuf {
+   public:
+    GzStreamBuf(const std::string &path) : reader_(path) {}
+
+    [[nodiscard]] bool is_open() const noexcept { return reader_.is_open(); }
+
+   protected:
+    int_type underflow() override;
+
+   private:
+    GzFileReader reader_;
+};
+
+/// @brief std::istream over a gzip file with large buffers, a faster igzstream.
+class GzStream : public std::istream {
+   public:
+    GzStream(const std::string &path) : std::istream(nullptr), buf_(path) {
+        rdbuf(&buf_);
+        if (!buf_.is_open()) setstate(std::ios::failbit);
+    }
+
+    [[nodiscard]] bool is_open() const noexcept { return buf_.is_open(); }
+
+   private:
+    GzStreamBuf buf_;
+};
@@ -0,0 +1,215 @@
+#include "metadata.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "./binary_io.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// bump whenever the entry layout or from_json(TestMetaData) changes
+constexpr std::uint32_t INDEX_VERSION = 1;
+constexpr char INDEX_MAGIC[8]         = {'A', 'N', 'A', 'M', 'E', 'T', 'A', 0};
+
+enum IndexFlags : std::uint8_t {
+    HAS_BOOK       = 1,
+    HAS_SPRT       = 2,
+    SPRT           = 4,
+    HAS_BOOK_DEPTH = 8,
+};
+
+struct IndexEntry {
+    FileInfo json;
+    TestMetaData meta;
+};
+
+using map_index = std::unordered_map<std::string, IndexEntry>;
+
+map_index read_index(const std::string &index_file) {
+    map_index index;
+
+    std::ifstream is(index_file, std::ios::binary);
+    if (!is.is_open()) return index;
+
+    char magic[sizeof(INDEX_MAGIC)];
+    std::uint32_t version = 0;
+    std::uint64_t count   = 0;
+
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !read_pod(is, version) || version != INDEX_VERSION || !read_pod(is, count)) {
+        return index;
+    }
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::string path;
+        IndexEntry entry;
+        std::uint8_t flags = 0;
+
+        if (!read_string(is, path) || !read_pod(is, entry.json.size) ||
+            !read_pod(is, entry.json.mtime) || !read_pod(is, flags)) {
+            return {};
+        }
+
+        if (flags & HAS_BOOK) {
+            std::string book;
+            if (!read_string(is, book)) return {};
+            entry.meta.book = book;
+        }
+
+        if (flags & HAS_SPRT) entry.meta.sprt = (flags & SPRT) != 0;
+
+        if (flags & HAS_BOOK_DEPTH) {
+            std::int32_t depth = 0;
+            if (!read_pod(is, depth)) return {};
+            entry.meta.book_depth = depth;
+        }
+
+        entry.json.valid = true;
+        index.emplace(std::move(path), std::move(entry));
+    }
+
+    return index;
+}
+
+void write_index(const std::string &index_file, const map_index &index) {
+    const auto tmp = index_file + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+
+        os.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        write_pod(os, INDEX_VERSION);
+        write_pod(os, static_cast<std::uint64_t>(index.size()));
+
+        for (const auto &[path, entry] : index) {
+            const auto &meta   = entry.meta;
+            std::uint8_t flags = 0;
+
+            if (meta.book) flags |= HAS_BOOK;
+            if (meta.sprt) flags |= HAS_SPRT | (*meta.sprt ? SPRT : 0);
+            if (meta.book_depth) flags |= HAS_BOOK_DEPTH;
+
+            write_string(os, path);
+            write_pod(os, entry.json.size);
+            write_pod(os, entry.json.mtime);
+            write_pod(os, flags);
+
+            if (meta.book) write_string(os, *meta.book);
+            if (meta.book_depth) write_pod(os, static_cast<std::int32_t>(*meta.book_depth));
+        }
+
+        if (!os) {
+            std::cerr << "Warning: could not write the metadata index " << index_file << std::endl;
+            return;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, index_file, ec);
+
+    if (ec) {
+        std::cerr << "Warning: could not write the metadata index " << index_file << std::endl;
+    }
+}
+}  // namespace
+
+TestFile test_of(const std::string &pathname) {
+    fs::path path(pathname);
+    const std::string filename = path.filename().string();
+
+    TestFile test;
+    test.id   = filename.substr(0, filename.find_first_of("-."));
+    test.path = (path.parent_path() / test.id).string();
+
+    return test;
+}
+
+map_meta load_metadata(const std::vector<std::string> &test_paths, const std::string &index_file,
+                       int concurrency) {
+    auto index = index_file.empty() ? map_index() : read_index(index_file);
+
+    std::vector<FileInfo> infos(test_paths.size());
+
+    // tests which are not in the index, or whose .json file changed
+    std::vector<std::size_t> stale;
+
+    for (std::size_t i = 0; i < test_paths.size(); i++) {
+        infos[i] = file_info(test_paths[i] + ".json");
+
+        if (!infos[i].valid) continue;
+
+        const auto it = index.find(test_paths[i]);
+
+        if (it == index.end() || it->second.json.size != infos[i].size ||
+            it->second.json.mtime != infos[i].mtime) {
+            stale.push_back(i);
+        }
+    }
+
+    std::vector<std::optional<TestMetaData>> parsed(stale.size());
+    std::vector<std::exception_ptr> errors(stale.size());
+    std::atomic<std::size_t> next = 0;
+
+    const auto parse = [&]() {
+        for (auto i = next++; i < stale.size(); i = next++) {
+            try {
+                std::ifstream json_file(test_paths[stale[i]] + ".json");
+
+                if (!json_file.is_open()) continue;
+
+                parsed[i] = nlohmann::json::parse(json_file).get<TestMetaData>();
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const auto num_threads = std::min<std::size_t>(std::max(1, concurrency), stale.size());
+
+    for (std::size_t t = 0; t < num_threads; t++) {
+        threads.emplace_back(parse);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // a broken .json file stops the analysis, as it did when parsing sequentially
+    for (const auto &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    for (std::size_t i = 0; i < stale.size(); i++) {
+        if (parsed[i]) {
+            index[test_paths[stale[i]]] = {infos[stale[i]], *parsed[i]};
+        } else {
+            index.erase(test_paths[stale[i]]);
+        }
+    }
+
+    if (!index_file.empty() && !stale.empty()) write_index(index_file, index);
+
+    map_meta meta_map;
+
+    for (std::size_t i = 0; i < test_paths.size(); i++) {
+        if (!infos[i].valid) continue;
+
+        const auto it = index.find(test_paths[i]);
+        if (it != index.end()) meta_map.emplace(test_paths[i], it->second.meta);
+    }
+
+    return meta_map;
+}
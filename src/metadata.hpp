@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./test.hpp"
+
+using map_meta = std::unordered_map<std::string, TestMetaData>;
+
+/// @brief Test a pgn file belongs to, derived from the file name once.
+struct TestFile {
+    // e.g. "abc123" for "dir/abc123-0.pgn.gz"
+    std::string id;
+
+    // "dir/abc123", the metadata is read from "dir/abc123.json"
+    std::string path;
+};
+
+[[nodiscard]] TestFile test_of(const std::string &pathname);
+
+/// @brief Reads the metadata of the given tests, tests without a .json file are left out.
+/// The .json files are parsed on several threads. With an index file only the fields of
+/// TestMetaData are kept on disk, and only tests whose .json file changed since the
+/// index was written are parsed again.
+/// @param test_paths TestFile::path of each test, without duplicates
+/// @param index_file empty to always parse the .json files
+/// @param concurrency
+/// @return
+[[nodiscard]] map_meta load_metadata(const std::vector<std::string> &test_paths,
+                                     const std::string &index_file, int concurrency);
@@ -0,0 +1,125 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+// a list of the form "0-31,64-95" as in cpulist and online
+std::vector<int> parse_list(const std::string &list) {
+    std::vector<int> values;
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        const auto dash = range.find('-');
+
+        try {
+            const int first = std::stoi(range.substr(0, dash));
+            const int last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+            for (int v = first; v <= last; v++) values.push_back(v);
+        } catch (const std::exception &) {
+            // an empty list, e.g. a node without CPUs, has no ranges at all
+        }
+    }
+
+    return values;
+}
+
+std::string read_line(const std::string &file) {
+    std::ifstream is(file);
+    std::string line;
+
+    std::getline(is, line);
+    return line;
+}
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+
+    return cpus;
+}
+}  // namespace
+
+NumaTopology NumaTopology::detect(std::size_t max_nodes) {
+    NumaTopology topology;
+
+    const auto allowed = allowed_cpus();
+
+#ifdef __linux__
+    const std::string root = "/sys/devices/system/node/";
+
+    for (const auto node : parse_list(read_line(root + "online"))) {
+        auto cpus = parse_list(read_line(root + "node" + std::to_string(node) + "/cpulist"));
+
+        // CPUs outside of the affinity mask, e.g. of taskset or a cgroup, are not used
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                  [&](int cpu) {
+                                      return !std::binary_search(allowed.begin(), allowed.end(),
+                                                                 cpu);
+                                  }),
+                   cpus.end());
+
+        if (cpus.empty()) continue;
+
+        topology.cpus_.push_back(std::move(cpus));
+
+        if (max_nodes && topology.cpus_.size() == max_nodes) break;
+    }
+#endif
+
+    if (topology.cpus_.empty()) topology.cpus_.push_back(allowed);
+
+    return topology;
+}
+
+bool NumaTopology::bind_thread(std::size_t node) const {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (const auto cpu : cpus_[node]) CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+std::string NumaTopology::describe() const {
+    std::string text = std::to_string(cpus_.size()) + (cpus_.size() == 1 ? " node" : " nodes");
+
+    for (std::size_t node = 0; node < cpus_.size(); node++) {
+        text += (node == 0 ? " with " : "/") + std::to_string(cpus_[node].size());
+    }
+
+    return text + " CPUs";
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// @brief The NUMA nodes of the machine with the CPUs this process may run on, read from
+/// /sys/devices/system/node on Linux. Elsewhere, or if the information is missing, there is
+/// a single node holding every CPU.
+class NumaTopology {
+   public:
+    /// @param max_nodes only the first max_nodes nodes with CPUs are used, 0 for all
+    /// @return
+    [[nodiscard]] static NumaTopology detect(std::size_t max_nodes = 0);
+
+    [[nodiscard]] std::size_t nodes() const noexcept { return cpus_.size(); }
+
+    [[nodiscard]] const std::vector<int> &cpus(std::size_t node) const { return cpus_[node]; }
+
+    /// @brief The node of a worker, the workers are dealt out to the nodes in turn.
+    /// @param worker
+    /// @return
+    [[nodiscard]] std::size_t node_of(std::size_t worker) const noexcept {
+        return worker % cpus_.size();
+    }
+
+    /// @brief Restricts the calling thread to the CPUs of node. Memory the thread touches
+    /// first is then placed on that node by the default policy of Linux.
+    /// @param node
+    /// @return false if the thread could not be pinned
+    bool bind_thread(std::size_t node) const;
+
+    /// @brief E.g. "2 nodes with 64/64 CPUs".
+    [[nodiscard]] std::string describe() const;
+
+   private:
+    std::vector<std::vector<int>> cpus_;
+};
@@ -0,0 +1,77 @@
+#include "opening_tree.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "./parallel.hpp"
+#include "./results.hpp"
+#include "./statistics.hpp"
+
+bool write_tree(const std::string &file, const tree_map_t &tree_map, std::size_t min_games,
+                std::size_t top_n, int concurrency, std::size_t &written) {
+    const auto threads = static_cast<std::size_t>(std::max(1, concurrency));
+
+    // every thread collects the nodes of its own submaps
+    std::vector<std::vector<const TreeNode *>> parts(threads);
+
+    run_threads(threads, [&](std::size_t t) {
+        for (std::size_t i = t; i < tree_map.subcnt(); i += threads) {
+            tree_map.with_submap(i, [&](const auto &set) {
+                for (const auto &[hash, node] : set) {
+                    if (std::size_t(node.wins) + node.draws + node.losses < min_games) continue;
+
+                    parts[t].push_back(&node);
+                }
+            });
+        }
+    });
+
+    std::vector<const TreeNode *> nodes;
+
+    for (auto &part : parts) {
+        nodes.insert(nodes.end(), part.begin(), part.end());
+        part = {};
+    }
+
+    // the rows are sorted like the results, the ply is looked up by the index of a row
+    std::vector<Statistics> stats(nodes.size());
+    std::vector<ResultRow> rows(nodes.size());
+
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        stats[i] = {nodes[i]->wins, nodes[i]->draws, nodes[i]->losses};
+        rows[i]  = ResultRow::of(nodes[i]->key, stats[i]);
+    }
+
+    sort_results(rows, top_n, concurrency);
+
+    std::FILE *out = std::fopen(file.c_str(), "wb");
+    if (!out) return false;
+
+    const std::string header = "FEN, Wins, Draws, Losses, Ply\n";
+    std::fwrite(header.data(), 1, header.size(), out);
+
+    char line[PositionKey::MAX_FEN_SIZE + 4 * 12];
+
+    for (const auto &row : rows) {
+        const auto &node = *nodes[row.stats - stats.data()];
+
+        char *p = row.key->write_fen(line);
+
+        for (const std::uint32_t value : {node.wins, node.draws, node.losses, node.ply}) {
+            *p++ = ',';
+            *p++ = ' ';
+            p    = std::to_chars(p, p + 10, value).ptr;
+        }
+
+        *p++ = '\n';
+        std::fwrite(line, 1, p - line, out);
+    }
+
+    written = rows.size();
+
+    const bool failed = std::ferror(out);
+    return std::fclose(out) == 0 && !failed;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../external/parallel_hashmap/phmap.h"
+#include "./position_key.hpp"
+
+/// @brief Statistics of a position of --treeDepth. A book exit is played far fewer than 2^32
+/// times, so 32 bit counters keep the table small. The key is only used to write the FEN, it
+/// is packed once when the position is first reached.
+struct TreeNode {
+    PositionKey key;
+    std::uint32_t wins   = 0;
+    std::uint32_t draws  = 0;
+    std::uint32_t losses = 0;
+
+    // the lowest ply after the book exit the position was reached at
+    std::uint32_t ply = 0;
+};
+
+// keyed by chess::Board::hash(), so that transpositions share a node
+using tree_map_t = phmap::parallel_flat_hash_map<
+    std::uint64_t, TreeNode, phmap::Hash<std::uint64_t>, phmap::EqualTo<std::uint64_t>,
+    std::allocator<std::pair<const std::uint64_t, TreeNode>>, 6, std::mutex>;
+
+/// @brief Writes "FEN, Wins, Draws, Losses, Ply" lines in the order of results.csv, the FENs
+/// have no move counters.
+/// @param file
+/// @param tree_map
+/// @param min_games
+/// @param top_n if not 0, only the first top_n positions are written
+/// @param concurrency
+/// @param written number of positions written
+/// @return false if the file could not be written
+bool write_tree(const std::string &file, const tree_map_t &tree_map, std::size_t min_games,
+                std::size_t top_n, int concurrency, std::size_t &written);
@@ -1,16 +1,87 @@
 #pragma once
 
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
-using map_fens = std::unordered_map<std::string, std::pair<int, int>>;
+#include "../external/parallel_hashmap/phmap.h"
+#include "./game_filter.hpp"
+
+// the default hash and equality of phmap also take a std::string_view for lookups
+using map_fens = phmap::flat_hash_map<std::string, std::pair<int, int>>;
+
+// what --groupBy splits the results by, the metadata of the test or a header of the game
+enum class GroupDimension { Book, BookDepth, Sprt, Test, TimeControl };
 
 struct CLIOptions {
     map_fens fixfens;
     std::string match_book;
+    std::string cache_dir;
+    std::string meta_index;
+    std::string manifest_file;
+    std::string stats_file;
     std::string dir        = "./pgns";
     int concurrency        = 1;
+    std::size_t top_n      = 0;
+    std::size_t min_games  = 0;
+    int shard_index        = 0;
+    int shard_count        = 1;
     bool conclusive        = false;
     bool only_sprt         = false;
     bool allow_duplicates  = false;
     bool matchBookInverted = false;
+    bool local_maps        = false;
+    bool binary            = false;
+
+    // empty without --groupBy
+    std::vector<GroupDimension> group_by;
+
+    // every game passes without --filter
+    GameFilter filter;
+
+    // histograms of the written positions, and the draw rate limits (in percent) of the
+    // filtered positions, if one is set
+    bool post_process = false;
+    std::optional<int> draw_rate_min;
+    std::optional<int> draw_rate_max;
+    std::size_t draw_rate_games = 10;
+
+    // --spill, 0 keeps all positions in memory. The runs go next to the results by default,
+    // the temporary directory often lives in memory itself
+    std::size_t spill_entries = 0;
+    std::string spill_dir     = ".";
+
+    // plies after the book exit of --treeDepth, 0 only counts the exits
+    std::size_t tree_depth = 0;
+
+    // share of the files sampled by --approx, 0 for an exact run
+    double approx_rate           = 0;
+    std::size_t approx_positions = 100000;
+
+    // --numa, and the number of nodes used, 0 for all of them
+    bool numa              = false;
+    std::size_t numa_nodes = 0;
+
+    // Chrome trace of --trace, empty without a trace, and the spans kept per thread
+    std::string trace_file;
+    std::size_t trace_events = 1 << 20;
+
+    // extension of the CSV results, ".csv.gz" or ".csv.zst" with --compress
+    std::string csv_extension = ".csv";
+
+    // --checkpoint, empty without checkpoints, and the seconds between two of them
+    std::string checkpoint_file;
+    std::size_t checkpoint_interval = 300;
+    bool resume                     = false;
+
+    // Unix domain socket of --serve, empty for a single run
+    std::string serve_socket;
+
+    // threads of the reader, inflater and parser stage of the pipeline
+    bool pipeline = false;
+    int readers   = 1;
+    int inflaters = 1;
+    int parsers   = 1;
 };
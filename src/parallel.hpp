@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/// @brief Calls f(0), ..., f(count - 1) on one thread each and waits for all of them.
+/// @param count
+/// @param f
+template <typename FUNC>
+void run_threads(std::size_t count, FUNC f) {
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < count; t++) {
+        threads.emplace_back(f, t);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+/// @brief Sorts equal parts on their own threads, then merges neighbouring runs until one
+/// is left, the merges of one round run in parallel as well.
+/// @param values
+/// @param cmp
+/// @param concurrency
+/// @param min_part parts are not made smaller than this
+template <typename T, typename CMP>
+void parallel_sort(std::vector<T> &values, CMP cmp, int concurrency,
+                   std::size_t min_part = 1 << 16) {
+    const auto part_size = std::max<std::size_t>(1, min_part);
+    const auto max_parts = std::max<std::size_t>(1, values.size() / part_size);
+    const auto parts     = std::clamp<std::size_t>(concurrency, 1, max_parts);
+
+    std::vector<std::size_t> bounds(parts + 1);
+
+    for (std::size_t i = 0; i <= parts; i++) {
+        bounds[i] = values.size() * i / parts;
+    }
+
+    run_threads(parts, [&](std::size_t i) {
+        std::sort(values.begin() + bounds[i], values.begin() + bounds[i + 1], cmp);
+    });
+
+    for (std::size_t width = 1; width < parts; width *= 2) {
+        const auto merges = (parts + 2 * width - 1) / (2 * width);
+
+        run_threads(merges, [&](std::size_t m) {
+            const auto first = 2 * width * m;
+            if (first + width >= parts) return;
+
+            const auto last = std::min(first + 2 * width, parts);
+
+            std::inplace_merge(values.begin() + bounds[first],
+                               values.begin() + bounds[first + width],
+                               values.begin() + bounds[last], cmp);
+        });
+    }
+}
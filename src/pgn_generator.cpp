@@ -0,0 +1,230 @@
+#include "pgn_generator.hpp"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../external/chess.hpp"
+
+using namespace chess;
+
+namespace {
+
+// splitmix64, unlike the <random> distributions its output does not depend on the library
+class Random {
+   public:
+    explicit Random(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+        z               = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z               = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [lo, hi]
+    int range(int lo, int hi) { return lo + static_cast<int>(next() % std::uint64_t(hi - lo + 1)); }
+
+    // index of the weight the random number falls into
+    std::size_t pick(const std::vector<int> &weights) {
+        int sum = 0;
+        for (const auto w : weights) sum += w;
+
+        int r = range(0, sum - 1);
+
+        for (std::size_t i = 0; i < weights.size(); i++) {
+            if (r < weights[i]) return i;
+            r -= weights[i];
+        }
+
+        return weights.size() - 1;
+    }
+
+   private:
+    std::uint64_t state_;
+};
+
+struct BookExit {
+    std::string fen;       // without move counters
+    std::string counters;  // "halfmove fullmove"
+};
+
+// a few random plies from the start position, which any legal game can continue from
+BookExit make_exit(Random &rng) {
+    Board board;
+    const int plies = rng.range(6, 14);
+
+    for (int ply = 0; ply < plies; ply++) {
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+
+        if (moves.empty()) break;
+
+        board.makeMove(moves[rng.range(0, moves.size() - 1)]);
+    }
+
+    const auto fen     = board.getFen(true);
+    const auto counter = fen.rfind(' ', fen.rfind(' ') - 1);
+
+    return {fen.substr(0, counter), fen.substr(counter + 1)};
+}
+
+struct Termination {
+    const char *tag;  // nullptr for a regular end of the game
+    int weight;
+};
+
+// roughly the mix found in fishtest archives
+const std::vector<Termination> TERMINATIONS = {
+    {nullptr, 55},       {"adjudication", 35},     {"time forfeit", 4}, {"abandoned", 2},
+    {"unterminated", 2}, {"stalled connection", 1}, {"illegal move", 1},
+};
+
+void append_wrapped(std::string &out, std::string &line, const std::string &token) {
+    // cutechess-cli wraps the move text at 80 columns
+    if (!line.empty() && line.size() + 1 + token.size() > 80) {
+        out += line;
+        out += '\n';
+        line.clear();
+    }
+
+    if (!line.empty()) line += ' ';
+    line += token;
+}
+
+void game(std::string &out, Random &rng, const std::vector<BookExit> &book, std::size_t round) {
+    const auto &exit     = book[rng.range(0, book.size() - 1)];
+    const bool startpos  = rng.range(0, 99) < 2;
+    const bool reset     = rng.range(0, 99) < 90;
+    const auto &term     = TERMINATIONS[rng.pick({55, 35, 4, 2, 2, 1, 1})];
+    const int max_plies  = rng.range(30, 180);
+    const bool new_white = round % 2 == 0;
+
+    const auto fen = startpos ? std::string(constants::STARTPOS)
+                              : exit.fen + (reset ? " 0 1" : " " + exit.counters);
+
+    // the move numbers follow the FEN header, like in cutechess-cli output
+    Board board(fen);
+
+    std::string moves, line;
+    int plies = 0;
+
+    for (; plies < max_plies; plies++) {
+        Movelist list;
+        movegen::legalmoves(list, board);
+
+        if (list.empty()) break;
+
+        const auto move = list[rng.range(0, list.size() - 1)];
+
+        if (board.sideToMove() == Color::WHITE) {
+            append_wrapped(moves, line, std::to_string(board.fullMoveNumber()) + ".");
+        } else if (plies == 0) {
+            append_wrapped(moves, line, std::to_string(board.fullMoveNumber()) + "...");
+        }
+
+        append_wrapped(moves, line, uci::moveToSan(board, move));
+
+        char comment[48];
+        std::snprintf(comment, sizeof(comment), "{%+.2f/%d %.3fs}", rng.range(-300, 300) / 100.0,
+                      rng.range(8, 30), rng.range(5, 900) / 1000.0);
+        append_wrapped(moves, line, comment);
+
+        board.makeMove(move);
+    }
+
+    std::string result;
+
+    if (term.tag && std::string_view(term.tag) == "unterminated") {
+        result = "*";
+    } else if (board.isGameOver().second == GameResult::LOSE) {
+        result = board.sideToMove() == Color::WHITE ? "0-1" : "1-0";
+    } else {
+        const char *results[] = {"1-0", "1/2-1/2", "0-1"};
+        result                = results[rng.pick({30, 42, 28})];
+    }
+
+    append_wrapped(moves, line, result);
+    moves += line;
+
+    const char *engines[] = {"New-e1b7c4d", "Base-9a3f21c"};
+
+    out += "[Event \"Batch " + std::to_string(round / 200 + 1) + ": test vs base\"]\n";
+    out += "[Site \"?\"]\n";
+    out += "[Date \"2024.03.17\"]\n";
+    out += "[Round \"" + std::to_string(round / 2 + 1) + "." + std::to_string(round % 2 + 1) +
+           "\"]\n";
+    out += std::string("[White \"") + engines[!new_white] + "\"]\n";
+    out += std::string("[Black \"") + engines[new_white] + "\"]\n";
+    out += "[Result \"" + result + "\"]\n";
+
+    if (!startpos) out += "[FEN \"" + fen + "\"]\n";
+
+    out += "[GameDuration \"00:00:" + std::to_string(rng.range(10, 59)) + "\"]\n";
+    out += "[PlyCount \"" + std::to_string(plies) + "\"]\n";
+
+    if (!startpos) out += "[SetUp \"1\"]\n";
+
+    if (term.tag) out += std::string("[Termination \"") + term.tag + "\"]\n";
+
+    out += "[TimeControl \"10.16+0.16\"]\n\n";
+    out += moves;
+    out += "\n\n";
+}
+
+}  // namespace
+
+GeneratedPgns generate_pgns(std::size_t games, std::uint64_t seed) {
+    Random rng(seed);
+    GeneratedPgns generated;
+
+    // a book exit is played about 20 times, like in a real test
+    std::vector<BookExit> book;
+    const auto book_size = std::max<std::size_t>(16, games / 20);
+
+    // games without a FEN header start from the start position, which --fixFENsource looks up
+    generated.book += std::string(constants::STARTPOS) + "\n";
+
+    for (std::size_t i = 0; i < book_size; i++) {
+        book.push_back(make_exit(rng));
+        generated.book += book.back().fen + " " + book.back().counters + "\n";
+    }
+
+    generated.pgn.reserve(games * 1500);
+
+    for (std::size_t i = 0; i < games; i++) {
+        game(generated.pgn, rng, book, i);
+    }
+
+    generated.games = games;
+
+    return generated;
+}
+
+std::string gzip_compress(const std::string &data, int level) {
+    z_stream strm = {};
+
+    // 16 selects the gzip wrapper
+    if (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+
+    std::string out(deflateBound(&strm, data.size()), '\0');
+
+    strm.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    strm.avail_in  = static_cast<uInt>(data.size());
+    strm.next_out  = reinterpret_cast<Bytef *>(out.data());
+    strm.avail_out = static_cast<uInt>(out.size());
+
+    const int ret = deflate(&strm, Z_FINISH);
+    out.resize(strm.total_out);
+    deflateEnd(&strm);
+
+    if (ret != Z_STREAM_END) throw std::runtime_error("deflate failed");
+
+    return out;
+}
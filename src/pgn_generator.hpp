@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// @brief Synthetic games in the form fishtest stores them, for benchmarks.
+struct GeneratedPgns {
+    std::string pgn;
+
+    // every book exit with its real move counters, as read by --fixFENsource
+    std::string book;
+
+    std::size_t games = 0;
+};
+
+/// @brief Plays random legal games with cutechess-cli headers. The games start from a pool of
+/// book exits whose FEN mostly carries the move counters reset to "0 1", and end with a mix of
+/// results and Termination tags. The same seed gives the same output on every platform.
+/// @param games
+/// @param seed
+/// @return
+[[nodiscard]] GeneratedPgns generate_pgns(std::size_t games, std::uint64_t seed);
+
+/// @brief Compresses data into a single gzip member.
+/// @param data
+/// @param level zlib compression level
+/// @return
+[[nodiscard]] std::string gzip_compress(const std::string &data, int level = 6);
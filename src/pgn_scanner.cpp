@@ -0,0 +1,246 @@
+#include "pgn_scanner.hpp"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__) || defined(__MACH__)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define HAS_MMAP 1
+#endif
+
+namespace {
+constexpr auto npos = std::string_view::npos;
+
+// a game starts with a '[' at the beginning of a line, which follows an empty line
+bool follows_empty_line(std::string_view data, std::size_t i) {
+    if (i < 2 || data[i - 1] != '\n') return false;
+    if (data[i - 2] == '\n') return true;
+    return i >= 3 && data[i - 2] == '\r' && data[i - 3] == '\n';
+}
+}  // namespace
+
+std::size_t find_next_game(std::string_view data, std::size_t from) {
+    while (from < data.size()) {
+        const auto *p =
+            static_cast<const char *>(std::memchr(data.data() + from, '[', data.size() - from));
+
+        if (!p) break;
+
+        const std::size_t i = p - data.data();
+
+        if (follows_empty_line(data, i)) return i;
+
+        from = i + 1;
+    }
+
+    return data.size();
+}
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0) {
+        size_ = static_cast<std::size_t>(st.st_size);
+
+        if (size_ == 0) {
+            is_open_ = true;
+        } else {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, size_, MADV_SEQUENTIAL);
+                data_    = static_cast<const char *>(addr);
+                is_open_ = true;
+            }
+        }
+    }
+
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef HAS_MMAP
+    if (data_) ::munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+std::size_t PgnHeaderScanner::feed(std::string_view data, bool eof) {
+    auto start    = pending_game_ ? 0 : find_game_start(data, resume_);
+    pending_game_ = false;
+    resume_       = 0;
+
+    while (start != npos) {
+        const auto body = read_headers(data, start, eof);
+
+        if (body == npos) {
+            // the header block continues in the next chunk
+            pending_game_ = true;
+            return start;
+        }
+
+        started_ = true;
+        start    = find_game_start(data, body);
+    }
+
+    if (eof) return data.size();
+
+    // keep the last bytes, a game start right after the boundary needs them as lookbehind
+    const std::size_t consumed = data.size() > 3 ? data.size() - 3 : 0;
+    resume_                    = data.size() - consumed;
+    return consumed;
+}
+
+std::size_t PgnHeaderScanner::find_game_start(std::string_view data, std::size_t from) const {
+    // before the first game everything up to a '[' is skipped, like the StreamParser does
+    if (!started_) return data.find('[', from);
+
+    const auto i = find_next_game(data, from);
+    return i == data.size() ? npos : i;
+}
+
+std::size_t PgnHeaderScanner::read_headers(std::string_view data, std::size_t start, bool eof) {
+    // the header block ends with the first line which is not a tag pair, usually an empty one
+    std::size_t body = npos;
+
+    for (std::size_t line = start; line < data.size();) {
+        const auto *nl =
+            static_cast<const char *>(std::memchr(data.data() + line, '\n', data.size() - line));
+
+        if (!nl) break;
+
+        const std::size_t next = nl - data.data() + 1;
+
+        if (data[line] != '[') {
+            body = next;
+            break;
+        }
+
+        line = next;
+    }
+
+    if (body == npos && !eof) return npos;
+
+    const auto end = body == npos ? data.size() : body;
+
+    // the moves are only read from a complete game
+    const auto game_end = moves_ && body != npos ? find_next_game(data, body) : end;
+
+    if (game_end == data.size() && !eof && moves_ && body != npos) return npos;
+
+    visitor_.skipPgn(false);
+    visitor_.startPgn();
+
+    for (std::size_t line = start; line < end && !visitor_.skip();) {
+        auto next = data.find('\n', line);
+        next      = next == npos || next >= end ? end : next + 1;
+
+        if (data[line] == '[') read_tag(data.substr(line, next - line));
+
+        line = next;
+    }
+
+    // a game without an empty line after the headers never reaches the move section
+    if (body != npos && !visitor_.skip()) visitor_.startMoves();
+
+    if (moves_ && body != npos && !visitor_.skip()) read_moves(data.substr(body, game_end - body));
+
+    visitor_.endPgn();
+    visitor_.skipPgn(false);
+
+    return end;
+}
+
+void PgnHeaderScanner::read_moves(std::string_view text) {
+    const auto is_space = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+
+    for (std::size_t i = 0; i < text.size() && !visitor_.skip();) {
+        const char c = text[i];
+
+        if (is_space(c)) {
+            i++;
+        } else if (c == '{') {
+            const auto close = text.find('}', i);
+            i                = close == npos ? text.size() : close + 1;
+        } else if (c == ';') {
+            const auto nl = text.find('\n', i);
+            i             = nl == npos ? text.size() : nl + 1;
+        } else if (c == '(') {
+            // variations may be nested
+            int depth = 0;
+
+            for (; i < text.size(); i++) {
+                if (text[i] == '(') depth++;
+                if (text[i] == ')' && --depth == 0) break;
+            }
+
+            i++;
+        } else {
+            auto end = i;
+
+            while (end < text.size() && !is_space(text[end]) && text[end] != '{' &&
+                   text[end] != '(' && text[end] != ';') {
+                end++;
+            }
+
+            auto token = text.substr(i, end - i);
+            i          = end;
+
+            // a move number, which may be directly followed by the move, e.g. "12." or "12...Nf3"
+            std::size_t digits = 0;
+
+            while (digits < token.size() && token[digits] >= '0' && token[digits] <= '9') digits++;
+
+            if (digits && digits < token.size() && token[digits] == '.') {
+                const auto move = token.find_first_not_of("0123456789.");
+
+                if (move == npos) continue;
+
+                token.remove_prefix(move);
+            }
+
+            if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") break;
+
+            if (token[0] == '$') continue;
+
+            visitor_.move(token, {});
+        }
+    }
+}
+
+void PgnHeaderScanner::read_tag(std::string_view line) {
+    // [Key "Value"]
+    const auto key_end = line.find_first_of(" \t\r\n", 1);
+    if (key_end == npos) return;
+
+    const auto quote = line.find('"', key_end);
+    if (quote == npos) return;
+
+    // the value ends at the first unescaped quote in front of a ']', so that it may contain
+    // a ']' itself, e.g. [Event "Cup [A]"]
+    auto close = npos;
+
+    for (auto i = quote + 1; i + 1 < line.size(); i++) {
+        if (line[i] == '\\') {
+            i++;
+        } else if (line[i] == '"' && line[i + 1] == ']') {
+            close = i + 1;
+            break;
+        }
+    }
+
+    // a tag without the closing quote still ends at its first ']'
+    if (close == npos) close = line.find(']', quote + 1);
+    if (close == npos || close < quote + 2) return;
+
+    visitor_.header(line.substr(1, key_end - 1), line.substr(quote + 1, close - quote - 2));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "../external/chess.hpp"
+
+/// @brief Read-only memory mapping of a whole file.
+class MappedFile {
+   public:
+    MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] bool is_open() const noexcept { return is_open_; }
+    [[nodiscard]] std::string_view view() const noexcept { return {data_, size_}; }
+
+   private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+    bool is_open_     = false;
+};
+
+/// @brief Finds the first game which starts at or after from, i.e. a '[' at the beginning
+/// of a line that follows an empty line.
+/// @param data
+/// @param from
+/// @return data.size() if there is none
+[[nodiscard]] std::size_t find_next_game(std::string_view data, std::size_t from);
+
+/// @brief Header-only alternative to pgn::StreamParser for visitors that skip every game
+/// in startMoves(). Only the tag pairs are parsed, the move sections are jumped over by
+/// searching for the next '[' that follows an empty line. The visitor sees the same
+/// startPgn/header/startMoves/endPgn calls as with the StreamParser, but never move().
+///
+/// With moves, a visitor which does not skip the game in startMoves() also gets move() for
+/// the SAN moves of the main line, without comments, until it skips the game. The rest of
+/// the move section is jumped over as before, so the cost depends on the moves read only.
+class PgnHeaderScanner {
+   public:
+    PgnHeaderScanner(chess::pgn::Visitor &vis, bool moves = false)
+        : visitor_(vis), moves_(moves) {}
+
+    /// @brief Reports all games whose header block is complete.
+    /// @param data
+    /// @param eof true if data holds the rest of the input
+    /// @return number of bytes consumed, the remainder has to be passed again
+    /// in front of the next chunk
+    std::size_t feed(std::string_view data, bool eof);
+
+   private:
+    [[nodiscard]] std::size_t find_game_start(std::string_view data, std::size_t from) const;
+
+    [[nodiscard]] std::size_t read_headers(std::string_view data, std::size_t start, bool eof);
+
+    void read_tag(std::string_view line);
+
+    void read_moves(std::string_view text);
+
+    chess::pgn::Visitor &visitor_;
+    bool moves_;
+
+    // true once the first game was seen, afterwards games have to start after an empty line
+    bool started_ = false;
+
+    // the previous chunk ended inside a header block, which starts the current chunk
+    bool pending_game_ = false;
+
+    // offset into the next chunk where the search for a game start continues
+    std::size_t resume_ = 0;
+};
@@ -0,0 +1,291 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "./run_stats.hpp"
+#include "./trace.hpp"
+
+namespace {
+// shorter waits are left out of the trace, most pushes and pops do not wait at all
+constexpr double TRACED_WAIT = 1e-5;
+
+// waiting for another stage, for a chunk or for room in a queue, is idle time
+template <typename FUNC>
+void wait(ThreadStats &stats, FUNC f) {
+    Stopwatch watch;
+    f();
+
+    const auto seconds = watch.lap();
+    stats.idle += seconds;
+
+    if (Trace::enabled() && seconds >= TRACED_WAIT) Trace::add_ending_now("wait", seconds);
+}
+
+// a pipeline thread is busy for its whole lifetime except for the waits
+class ThreadTimer {
+   public:
+    ThreadTimer(const char *role) : stats_(thread_stats(role)), idle_(stats_.idle) {}
+
+    ~ThreadTimer() { stats_.busy += watch_.lap() - (stats_.idle - idle_); }
+
+    ThreadStats &stats() { return stats_; }
+
+   private:
+    ThreadStats &stats_;
+    double idle_;
+    Stopwatch watch_;
+};
+}  // namespace
+
+Pipeline::Pipeline(int readers, int inflaters, int parsers)
+    : readers_(std::max(1, readers)),
+      free_buffers_(QUEUE_SIZE * (std::max(1, inflaters) + std::max(1, parsers) + 1)) {
+    for (int i = 0; i < std::max(1, inflaters); i++) {
+        inflate_queues_.push_back(std::make_unique<Queue>(QUEUE_SIZE));
+    }
+
+    for (int i = 0; i < std::max(1, parsers); i++) {
+        parse_queues_.push_back(std::make_unique<Queue>(QUEUE_SIZE));
+    }
+}
+
+void Pipeline::run(const std::vector<std::string> &files, const SinkFactory &make_sink) {
+    std::vector<Task> tasks(files.size());
+
+    for (std::size_t i = 0; i < files.size(); i++) {
+        tasks[i].file  = files[i];
+        tasks[i].index = i;
+        tasks[i].gzip  = files[i].size() >= 3 && files[i].substr(files[i].size() - 3) == ".gz";
+    }
+
+    std::atomic<std::size_t> next = 0;
+
+    std::vector<std::thread> parsers, inflaters, readers;
+
+    for (auto &queue : parse_queues_) {
+        parsers.emplace_back([this, &queue, &make_sink]() { parse(*queue, make_sink); });
+    }
+
+    for (auto &queue : inflate_queues_) {
+        inflaters.emplace_back([this, &queue]() { inflate(*queue); });
+    }
+
+    for (int i = 0; i < readers_; i++) {
+        readers.emplace_back([this, &tasks, &next]() { read(tasks, next); });
+    }
+
+    // each stage is stopped once the stage in front of it has delivered everything
+    for (auto &thread : readers) thread.join();
+
+    for (auto &queue : inflate_queues_) queue->push(Chunk{});
+    for (auto &thread : inflaters) thread.join();
+
+    for (auto &queue : parse_queues_) queue->push(Chunk{});
+    for (auto &thread : parsers) thread.join();
+}
+
+void Pipeline::read(std::vector<Task> &tasks, std::atomic<std::size_t> &next) {
+    ThreadTimer timer("reader");
+    auto &stats = timer.stats();
+
+    for (auto i = next++; i < tasks.size(); i = next++) {
+        auto &task  = tasks[i];
+        auto &queue = task.gzip ? inflate_queue(task) : parse_queue(task);
+
+        std::FILE *file = nullptr;
+
+        {
+            const TraceSpan span("open", task.file);
+            file = std::fopen(task.file.c_str(), "rb");
+        }
+
+        if (!file) {
+            Chunk chunk;
+            chunk.task  = &task;
+            chunk.last  = true;
+            chunk.error = "Could not open " + task.file;
+            wait(stats, [&]() { queue.push(std::move(chunk)); });
+            continue;
+        }
+
+        bool last = false;
+
+        while (!last) {
+            Chunk chunk;
+            chunk.task = &task;
+            chunk.data = acquire_buffer();
+
+            {
+                const TraceSpan span("read", task.file);
+                Stopwatch watch;
+                chunk.size = std::fread(chunk.data.data(), 1, chunk.data.size(), file);
+                stats.read += watch.lap();
+            }
+
+            if (task.gzip) stats.compressed_bytes += chunk.size;
+            if (read_bytes_) read_bytes_->fetch_add(chunk.size, std::memory_order_relaxed);
+
+            last = chunk.size < chunk.data.size();
+
+            if (last && std::ferror(file)) chunk.error = "Could not read " + task.file;
+
+            chunk.last = last;
+            wait(stats, [&]() { queue.push(std::move(chunk)); });
+        }
+
+        std::fclose(file);
+    }
+}
+
+void Pipeline::inflate(Queue &queue) {
+    ThreadTimer timer("inflater");
+    auto &stats = timer.stats();
+
+    // the decoders of finished files are reset and used again, zlib allocates its window once
+    std::vector<std::unique_ptr<GzDecoder>> free_decoders;
+
+    while (true) {
+        Chunk chunk;
+        wait(stats, [&]() { chunk = queue.pop(); });
+
+        if (!chunk.task) return;
+
+        auto &task = *chunk.task;
+
+        if (!task.decoder && !free_decoders.empty()) {
+            task.decoder = std::move(free_decoders.back());
+            free_decoders.pop_back();
+        }
+
+        if (!task.decoder) task.decoder = std::make_unique<GzDecoder>();
+
+        auto &decoder = *task.decoder;
+
+        // after an error the rest of the file is dropped
+        if (task.error.empty() && !decoder.finished()) {
+            try {
+                decoder.set_input({chunk.data.data(), chunk.size});
+
+                if (chunk.last) decoder.set_input_end();
+
+                while (!decoder.finished() && (chunk.last || !decoder.needs_input())) {
+                    if (task.inflated.empty()) task.inflated = acquire_buffer();
+
+                    std::size_t bytes = 0;
+
+                    {
+                        const TraceSpan span("inflate", task.file);
+                        Stopwatch watch;
+                        bytes = decoder.decode(task.inflated.data() + task.filled,
+                                               task.inflated.size() - task.filled);
+                        stats.inflate += watch.lap();
+                    }
+
+                    task.filled += bytes;
+                    stats.decompressed_bytes += bytes;
+
+                    if (task.filled == task.inflated.size()) send_inflated(task, false);
+                }
+            } catch (const std::exception &e) {
+                task.error = e.what();
+            }
+        }
+
+        release_buffer(std::move(chunk.data));
+
+        if (chunk.last) {
+            send_inflated(task, true, chunk.error.empty() ? task.error : chunk.error);
+
+            task.decoder->reset();
+            free_decoders.push_back(std::move(task.decoder));
+        }
+    }
+}
+
+void Pipeline::send_inflated(Task &task, bool last, const std::string &error) {
+    Chunk chunk;
+    chunk.task  = &task;
+    chunk.data  = std::move(task.inflated);
+    chunk.size  = task.filled;
+    chunk.last  = last;
+    chunk.error = error;
+
+    task.inflated = {};
+    task.filled   = 0;
+
+    wait(thread_stats(), [&]() { parse_queue(task).push(std::move(chunk)); });
+}
+
+void Pipeline::parse(Queue &queue, const SinkFactory &make_sink) {
+    ThreadTimer timer("parser");
+    auto &stats = timer.stats();
+
+    while (true) {
+        Chunk chunk;
+        wait(stats, [&]() { chunk = queue.pop(); });
+
+        if (!chunk.task) return;
+
+        auto &task = *chunk.task;
+
+        if (!task.sink) task.sink = make_sink(task.file);
+
+        std::string_view data(chunk.data.data(), chunk.size);
+
+        // the unconsumed end of the previous chunk goes in front of this one
+        const bool carried = !task.carry.empty();
+
+        if (carried) {
+            task.carry.append(data);
+            data = task.carry;
+        }
+
+        std::size_t consumed = 0;
+
+        {
+            const TraceSpan span("parse", task.file);
+            Stopwatch watch;
+            consumed = task.sink->feed(data, chunk.last);
+            stats.parse += watch.lap();
+        }
+        stats.parsed_bytes += chunk.size;
+
+        if (carried) {
+            task.carry.erase(0, consumed);
+        } else {
+            task.carry.assign(data.substr(consumed));
+        }
+
+        release_buffer(std::move(chunk.data));
+
+        if (chunk.last) {
+            stats.files++;
+            task.sink->finish(chunk.error);
+            task.sink.reset();
+            task.carry = {};
+        }
+    }
+}
+
+std::vector<char> Pipeline::acquire_buffer() {
+    std::vector<char> buffer;
+
+    if (!free_buffers_.try_pop(buffer) || buffer.size() != BUFFER_SIZE) {
+        buffer.resize(BUFFER_SIZE);
+    }
+
+    return buffer;
+}
+
+void Pipeline::release_buffer(std::vector<char> &&buffer) {
+    if (buffer.size() != BUFFER_SIZE) return;
+
+    // the buffer is simply freed if the pool is full
+    free_buffers_.try_push(buffer);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./bounded_queue.hpp"
+#include "./gz_reader.hpp"
+
+/// @brief Parser side of one file in a Pipeline.
+class FileSink {
+   public:
+    virtual ~FileSink() = default;
+
+    /// @brief Same contract as PgnHeaderScanner::feed.
+    /// @param data
+    /// @param eof true if data holds the rest of the file
+    /// @return number of bytes consumed, the remainder is passed again in front of the next chunk
+    virtual std::size_t feed(std::string_view data, bool eof) = 0;
+
+    /// @brief Called once after the last chunk of the file.
+    /// @param error empty if the file was read completely, otherwise the reason it was not
+    virtual void finish(const std::string &error) = 0;
+};
+
+/// @brief Reads, inflates and parses files on separate groups of threads, which are connected
+/// by bounded queues of large buffers. Reader threads prefetch the raw bytes of one file
+/// after another, inflater threads decompress the .gz files and parser threads hand the
+/// text to a FileSink.
+///
+/// All chunks of a file go through the same inflater and the same parser, in order, so the
+/// zlib stream and the parser state never change threads, and a stage only ever waits for
+/// the stage behind it.
+class Pipeline {
+   public:
+    // size of the raw as well as of the inflated chunks
+    static constexpr std::size_t BUFFER_SIZE = 1 << 22;
+
+    // chunks per queue, this bounds the memory held by the pipeline
+    static constexpr std::size_t QUEUE_SIZE = 4;
+
+    /// @brief Creates the sink of a file, on the parser thread that will feed it.
+    using SinkFactory = std::function<std::unique_ptr<FileSink>(const std::string &file)>;
+
+    Pipeline(int readers, int inflaters, int parsers);
+
+    /// @brief Makes the readers add the size of every chunk they read to counter.
+    /// @param counter has to outlive run()
+    void count_read_bytes(std::atomic<std::uint64_t> *counter) noexcept { read_bytes_ = counter; }
+
+    /// @brief Blocks until all files went through the pipeline.
+    /// @param files in the order the readers should pick them up
+    /// @param make_sink
+    void run(const std::vector<std::string> &files, const SinkFactory &make_sink);
+
+   private:
+    struct Task {
+        std::string file;
+        std::size_t index = 0;
+        bool gzip         = false;
+
+        // owned by the inflater of the task
+        std::unique_ptr<GzDecoder> decoder;
+        std::vector<char> inflated;
+        std::size_t filled = 0;
+        std::string error;
+
+        // owned by the parser of the task
+        std::unique_ptr<FileSink> sink;
+        std::string carry;
+    };
+
+    // a chunk without a task stops the thread which receives it
+    struct Chunk {
+        Task *task = nullptr;
+        std::vector<char> data;
+        std::size_t size = 0;
+        bool last        = false;
+
+        // set on the last chunk if the file could not be read completely
+        std::string error;
+    };
+
+    using Queue = BoundedQueue<Chunk>;
+
+    void read(std::vector<Task> &tasks, std::atomic<std::size_t> &next);
+    void inflate(Queue &queue);
+    void parse(Queue &queue, const SinkFactory &make_sink);
+
+    void send_inflated(Task &task, bool last, const std::string &error = "");
+
+    [[nodiscard]] Queue &inflate_queue(const Task &task) {
+        return *inflate_queues_[task.index % inflate_queues_.size()];
+    }
+
+    [[nodiscard]] Queue &parse_queue(const Task &task) {
+        return *parse_queues_[task.index % parse_queues_.size()];
+    }
+
+    [[nodiscard]] std::vector<char> acquire_buffer();
+    void release_buffer(std::vector<char> &&buffer);
+
+    int readers_;
+    std::atomic<std::uint64_t> *read_bytes_ = nullptr;
+
+    std::vector<std::unique_ptr<Queue>> inflate_queues_;
+    std::vector<std::unique_ptr<Queue>> parse_queues_;
+
+    // consumed buffers are handed back to the producers instead of being freed
+    BoundedQueue<std::vector<char>> free_buffers_;
+};
@@ -0,0 +1,278 @@
+#include "position_key.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+constexpr std::string_view PIECES   = "PNBRQKpnbrqk";
+constexpr std::string_view CASTLING = "KQkqABCDEFGHabcdefgh";
+
+constexpr std::uint32_t COUNTERS_FLAG = 1u << 23;
+constexpr std::uint32_t RAW_FLAG      = 1u << 22;
+
+// the texts of the raw keys, only games whose FEN from_fen() rejects add to it
+std::mutex raw_mutex;
+std::unordered_map<PositionKey, std::string, PositionKeyHash> raw_fens;
+
+std::uint64_t fnv1a(std::string_view text, std::uint64_t hash) {
+    for (const char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+// decimal number without leading zeros, as written by to_fen()
+std::optional<int> parse_counter(std::string_view str) {
+    if (str.empty() || str.size() > 5 || (str.size() > 1 && str[0] == '0')) return std::nullopt;
+
+    int value = 0;
+
+    for (const char c : str) {
+        if (c < '0' || c > '9') return std::nullopt;
+        value = value * 10 + (c - '0');
+    }
+
+    if (value > 0xffff) return std::nullopt;
+
+    return value;
+}
+
+std::string_view next_field(std::string_view &fen) {
+    const auto pos   = fen.find(' ');
+    const auto field = fen.substr(0, pos);
+    fen              = pos == std::string_view::npos ? std::string_view() : fen.substr(pos + 1);
+    return field;
+}
+}  // namespace
+
+std::optional<PositionKey> PositionKey::from_fen(std::string_view fen) {
+    // fields are separated by exactly one space
+    if (fen.empty() || fen.back() == ' ' || fen.find("  ") != std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    PositionKey key;
+
+    const auto placement = next_field(fen);
+
+    std::uint64_t occupancy = 0;
+    int square = 0, pieces = 0, rank_squares = 0, ranks = 1;
+    bool last_digit = false;
+
+    for (const char c : placement) {
+        if (c == '/') {
+            if (rank_squares != 8 || ranks == 8) return std::nullopt;
+            rank_squares = 0;
+            last_digit   = false;
+            ranks++;
+        } else if (c >= '1' && c <= '8') {
+            // "44" would describe the same rank as "8"
+            if (last_digit) return std::nullopt;
+            rank_squares += c - '0';
+            square += c - '0';
+            last_digit = true;
+        } else {
+            const auto piece = PIECES.find(c);
+            if (piece == std::string_view::npos || pieces == 32) return std::nullopt;
+
+            key.data_[8 + pieces / 2] |= static_cast<unsigned char>(piece << (4 * (pieces % 2)));
+            occupancy |= std::uint64_t(1) << square;
+
+            rank_squares++;
+            square++;
+            pieces++;
+            last_digit = false;
+        }
+
+        if (rank_squares > 8) return std::nullopt;
+    }
+
+    if (ranks != 8 || rank_squares != 8) return std::nullopt;
+
+    std::memcpy(key.data_, &occupancy, sizeof(occupancy));
+
+    const auto side = next_field(fen);
+    if (side != "w" && side != "b") return std::nullopt;
+
+    const auto castling = next_field(fen);
+    std::uint32_t flags = 0;
+
+    if (castling != "-") {
+        if (castling.empty() || castling.size() > 4) return std::nullopt;
+
+        for (std::size_t i = 0; i < castling.size(); i++) {
+            const auto idx = CASTLING.find(castling[i]);
+            if (idx == std::string_view::npos) return std::nullopt;
+            flags |= static_cast<std::uint32_t>(idx + 1) << (5 * i);
+        }
+    }
+
+    const auto ep = next_field(fen);
+    int ep_square = 0;
+
+    if (ep != "-") {
+        if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || ep[1] < '1' || ep[1] > '8') {
+            return std::nullopt;
+        }
+
+        ep_square = ('8' - ep[1]) * 8 + (ep[0] - 'a') + 1;
+    }
+
+    key.data_[24] = static_cast<unsigned char>((side == "b" ? 0x80 : 0) | ep_square);
+
+    if (!fen.empty()) {
+        const auto halfmove = parse_counter(next_field(fen));
+        const auto fullmove = parse_counter(next_field(fen));
+
+        if (!halfmove || !fullmove || !fen.empty()) return std::nullopt;
+
+        flags |= COUNTERS_FLAG;
+        key.write16(28, *halfmove);
+        key.write16(30, *fullmove);
+    }
+
+    key.data_[25] = static_cast<unsigned char>(flags & 0xff);
+    key.data_[26] = static_cast<unsigned char>((flags >> 8) & 0xff);
+    key.data_[27] = static_cast<unsigned char>(flags >> 16);
+
+    return key;
+}
+
+PositionKey PositionKey::from_raw_fen(std::string_view fen) {
+    // the second hash starts from the first, two texts would have to collide in both
+    std::uint64_t hashes[2];
+    hashes[0] = fnv1a(fen, 0xcbf29ce484222325ULL);
+    hashes[1] = fnv1a(fen, hashes[0] ^ 0x9e3779b97f4a7c15ULL);
+
+    PositionKey key;
+    std::memcpy(key.data_, hashes, sizeof(hashes));
+
+    // the side to move as far as the text shows it, for the histograms of --postProcess
+    auto fields = fen;
+    next_field(fields);
+
+    key.data_[24] = next_field(fields) == "b" ? 0x80 : 0;
+    key.data_[27] = static_cast<unsigned char>(RAW_FLAG >> 16);
+
+    add_raw_fen(key, fen);
+
+    return key;
+}
+
+void PositionKey::add_raw_fen(const PositionKey &key, std::string_view fen) {
+    const std::lock_guard<std::mutex> lock(raw_mutex);
+
+    if (raw_fens.find(key) == raw_fens.end()) raw_fens.emplace(key, std::string(fen));
+}
+
+std::string PositionKey::to_fen() const {
+    if (is_raw()) {
+        std::string fen(fen_capacity(), ' ');
+        fen.resize(write_fen(fen.data()) - fen.data());
+        return fen;
+    }
+
+    char buffer[MAX_FEN_SIZE];
+    return std::string(buffer, write_fen(buffer));
+}
+
+std::size_t PositionKey::fen_capacity() const {
+    if (!is_raw()) return MAX_FEN_SIZE;
+
+    const std::lock_guard<std::mutex> lock(raw_mutex);
+
+    const auto it = raw_fens.find(*this);
+    return it == raw_fens.end() ? 0 : it->second.size();
+}
+
+char *PositionKey::write_fen(char *out) const noexcept {
+    if (is_raw()) {
+        const std::lock_guard<std::mutex> lock(raw_mutex);
+
+        // only a damaged file could hold a raw key without its text
+        const auto it = raw_fens.find(*this);
+        if (it == raw_fens.end()) return out;
+
+        return std::copy(it->second.begin(), it->second.end(), out);
+    }
+
+    std::uint64_t occupancy;
+    std::memcpy(&occupancy, data_, sizeof(occupancy));
+
+    int piece = 0;
+
+    for (int rank = 0; rank < 8; rank++) {
+        int empty = 0;
+
+        for (int file = 0; file < 8; file++) {
+            if (!(occupancy >> (rank * 8 + file) & 1)) {
+                empty++;
+                continue;
+            }
+
+            if (empty) *out++ = static_cast<char>('0' + empty);
+            empty = 0;
+
+            *out++ = PIECES[(data_[8 + piece / 2] >> (4 * (piece % 2))) & 0xf];
+            piece++;
+        }
+
+        if (empty) *out++ = static_cast<char>('0' + empty);
+        if (rank < 7) *out++ = '/';
+    }
+
+    *out++ = ' ';
+    *out++ = black_to_move() ? 'b' : 'w';
+    *out++ = ' ';
+
+    const std::uint32_t flags = data_[25] | data_[26] << 8 | data_[27] << 16;
+
+    if ((flags & 0x1f) == 0) {
+        *out++ = '-';
+    }
+
+    for (int i = 0; i < 4; i++) {
+        const auto idx = (flags >> (5 * i)) & 0x1f;
+        if (!idx) break;
+        *out++ = CASTLING[idx - 1];
+    }
+
+    *out++ = ' ';
+
+    const int ep_square = data_[24] & 0x7f;
+
+    if (ep_square) {
+        *out++ = static_cast<char>('a' + (ep_square - 1) % 8);
+        *out++ = static_cast<char>('8' - (ep_square - 1) / 8);
+    } else {
+        *out++ = '-';
+    }
+
+    if (has_counters()) {
+        *out++ = ' ';
+        out    = std::to_chars(out, out + 5, halfmove()).ptr;
+        *out++ = ' ';
+        out    = std::to_chars(out, out + 5, fullmove()).ptr;
+    }
+
+    return out;
+}
+
+bool PositionKey::set_counters(int halfmove, int fullmove) noexcept {
+    if (halfmove < 0 || halfmove > 0xffff || fullmove < 0 || fullmove > 0xffff) return false;
+
+    data_[27] |= 0x80;
+    write16(28, halfmove);
+    write16(30, fullmove);
+
+    return true;
+}
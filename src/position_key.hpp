@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// @brief Lossless 32 byte encoding of a FEN, used as key instead of the FEN text.
+///
+/// bytes  0..7   occupancy, bit i is set if the i-th square in FEN order (a8, b8, ..., h1)
+///               holds a piece
+/// bytes  8..23  one nibble per occupied square, index into "PNBRQKpnbrqk"
+/// byte   24     side to move (bit 7) and en passant square + 1 (0 for none)
+/// bytes 25..27  up to four castling characters of five bits each, 0 ends the list,
+///               and a flag whether the move counters are present (bit 23)
+/// bytes 28..31  halfmove clock and fullmove number, 16 bit each
+///
+/// The move counters are stored last, so that sorting by the raw bytes puts all
+/// counter variants of a position next to each other.
+///
+/// A FEN which is not in the canonical form is kept as text instead, see from_raw_fen(). Its
+/// key holds a 128 bit hash of the text in bytes 0..15, the side to move and bit 22 of the
+/// flags, which no packed FEN sets.
+class PositionKey {
+   public:
+    static constexpr std::size_t SIZE = 32;
+
+    /// @brief Packs a FEN, which has to be written in the canonical form that to_fen()
+    /// produces, with or without the move counters.
+    /// @param fen
+    /// @return std::nullopt if the FEN cannot be reproduced from the packed form
+    [[nodiscard]] static std::optional<PositionKey> from_fen(std::string_view fen);
+
+    /// @brief Keeps a FEN which from_fen() cannot pack, e.g. one with a leading zero in a
+    /// counter or text after the counters, so that its games are counted under the text as it
+    /// is. The text is kept in a table of the process, which lives as long as the process.
+    /// @param fen
+    /// @return
+    [[nodiscard]] static PositionKey from_raw_fen(std::string_view fen);
+
+    /// @brief Registers the text of a raw key which was read from a file.
+    /// @param key
+    /// @param fen
+    static void add_raw_fen(const PositionKey &key, std::string_view fen);
+
+    [[nodiscard]] std::string to_fen() const;
+
+    // longest FEN write_fen() can produce for a packed key, including both move counters
+    static constexpr std::size_t MAX_FEN_SIZE = 100;
+
+    /// @brief Writes the same text as to_fen() without allocating.
+    /// @param out has to hold fen_capacity() characters
+    /// @return end of the written FEN
+    char *write_fen(char *out) const noexcept;
+
+    /// @brief MAX_FEN_SIZE, or the length of the text of a raw key, which may be longer.
+    [[nodiscard]] std::size_t fen_capacity() const;
+
+    /// @brief True for a key of from_raw_fen(), whose text has to be written next to it
+    /// wherever the key is stored outside the process.
+    [[nodiscard]] bool is_raw() const noexcept { return data_[27] & 0x40; }
+
+    [[nodiscard]] bool black_to_move() const noexcept { return data_[24] & 0x80; }
+
+    [[nodiscard]] bool has_counters() const noexcept { return data_[27] & 0x80; }
+
+    [[nodiscard]] int halfmove() const noexcept { return read16(28); }
+
+    [[nodiscard]] int fullmove() const noexcept { return read16(30); }
+
+    /// @brief Returns false if a counter does not fit into 16 bits.
+    /// @param halfmove
+    /// @param fullmove
+    /// @return
+    bool set_counters(int halfmove, int fullmove) noexcept;
+
+    /// @brief The same position without the move counters, shared by all counter variants.
+    [[nodiscard]] PositionKey without_counters() const noexcept {
+        PositionKey key = *this;
+        key.data_[27] &= 0x7f;
+        key.write16(28, 0);
+        key.write16(30, 0);
+        return key;
+    }
+
+    [[nodiscard]] const unsigned char *data() const noexcept { return data_; }
+
+    [[nodiscard]] std::uint64_t word(std::size_t i) const noexcept {
+        std::uint64_t w;
+        std::memcpy(&w, data_ + 8 * i, sizeof(w));
+        return w;
+    }
+
+    bool operator==(const PositionKey &other) const noexcept {
+        return std::memcmp(data_, other.data_, SIZE) == 0;
+    }
+
+    bool operator!=(const PositionKey &other) const noexcept { return !(*this == other); }
+
+    bool operator<(const PositionKey &other) const noexcept {
+        return std::memcmp(data_, other.data_, SIZE) < 0;
+    }
+
+   private:
+    [[nodiscard]] int read16(std::size_t i) const noexcept { return data_[i] | data_[i + 1] << 8; }
+
+    void write16(std::size_t i, int value) noexcept {
+        data_[i]     = static_cast<unsigned char>(value & 0xff);
+        data_[i + 1] = static_cast<unsigned char>(value >> 8);
+    }
+
+    alignas(8) unsigned char data_[SIZE] = {};
+};
+
+struct PositionKeyHash {
+    std::size_t operator()(const PositionKey &key) const noexcept {
+        std::uint64_t hash = 0x9e3779b97f4a7c15ULL;
+
+        for (std::size_t i = 0; i < PositionKey::SIZE / 8; i++) {
+            hash = (hash ^ key.word(i)) * 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 32;
+        }
+
+        return static_cast<std::size_t>(hash);
+    }
+};
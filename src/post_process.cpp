@@ -0,0 +1,200 @@
+#include "post_process.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../external/json.hpp"
+#include "./parallel.hpp"
+
+namespace {
+struct Merged {
+    // index of the first variant among the rows
+    std::size_t first;
+    Statistics stats;
+};
+
+using merged_map_t = phmap::parallel_flat_hash_map<
+    PositionKey, Merged, PositionKeyHash, std::equal_to<PositionKey>,
+    std::allocator<std::pair<const PositionKey, Merged>>, 6, std::mutex>;
+
+// same truncation as int(D / G * 100) in post_process_csv.py
+int draw_percent(const Statistics &stats) {
+    return static_cast<int>(double(stats.draws) / stats.total() * 100);
+}
+
+std::size_t thread_count(int concurrency, std::size_t rows) {
+    // a thread is not worth starting for a handful of rows
+    return std::clamp<std::size_t>(concurrency, 1, std::max<std::size_t>(1, rows >> 14));
+}
+}  // namespace
+
+MergedPositions merge_counters(const std::vector<ResultRow> &rows, int concurrency) {
+    const auto threads = thread_count(concurrency, rows.size());
+
+    merged_map_t merged;
+
+    run_threads(threads, [&](std::size_t t) {
+        const auto begin = rows.size() * t / threads;
+        const auto end   = rows.size() * (t + 1) / threads;
+
+        for (std::size_t i = begin; i < end; i++) {
+            const auto &stats = *rows[i].stats;
+
+            merged.lazy_emplace_l(
+                rows[i].key->without_counters(),
+                [&](merged_map_t::value_type &v) {
+                    v.second.stats += stats;
+                    v.second.first = std::min(v.second.first, i);
+                },
+                [&](const merged_map_t::constructor &ctor) {
+                    ctor(rows[i].key->without_counters(), Merged{i, stats});
+                });
+        }
+    });
+
+    // every thread collects the entries of its own submaps
+    std::vector<std::vector<Merged>> parts(threads);
+
+    run_threads(threads, [&](std::size_t t) {
+        for (std::size_t i = t; i < merged.subcnt(); i += threads) {
+            merged.with_submap(i, [&](const auto &set) {
+                for (const auto &[key, entry] : set) parts[t].push_back(entry);
+            });
+        }
+    });
+
+    std::vector<Merged> entries;
+    entries.reserve(merged.size());
+
+    for (auto &part : parts) {
+        entries.insert(entries.end(), part.begin(), part.end());
+        part = {};
+    }
+
+    parallel_sort(
+        entries, [](const Merged &a, const Merged &b) { return a.first < b.first; },
+        static_cast<int>(threads));
+
+    MergedPositions result;
+    result.stats.reserve(entries.size());
+    result.rows.reserve(entries.size());
+
+    for (const auto &entry : entries) result.stats.push_back(entry.stats);
+
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        result.rows.push_back(ResultRow::of(*rows[entries[i].first].key, result.stats[i]));
+    }
+
+    return result;
+}
+
+PositionHistograms histograms(const std::vector<ResultRow> &rows, int concurrency) {
+    const auto threads = thread_count(concurrency, rows.size());
+
+    std::vector<PositionHistograms> parts(threads);
+
+    run_threads(threads, [&](std::size_t t) {
+        auto &part = parts[t];
+
+        const auto begin = rows.size() * t / threads;
+        const auto end   = rows.size() * (t + 1) / threads;
+
+        for (std::size_t i = begin; i < end; i++) {
+            const auto &key   = *rows[i].key;
+            const auto &stats = *rows[i].stats;
+            const bool black  = key.black_to_move();
+
+            if (key.has_counters()) part.depth[(key.fullmove() - 1) * 2 + black]++;
+
+            if (stats.total()) part.draw_rate[draw_percent(stats)]++;
+
+            part.games[stats.total()]++;
+            part.total_games += stats.total();
+            part.white_games += black ? 0 : stats.total();
+        }
+
+        part.positions = end - begin;
+    });
+
+    PositionHistograms result;
+
+    for (const auto &part : parts) {
+        for (const auto &[value, count] : part.draw_rate) result.draw_rate[value] += count;
+        for (const auto &[value, count] : part.depth) result.depth[value] += count;
+        for (const auto &[value, count] : part.games) result.games[value] += count;
+
+        result.positions += part.positions;
+        result.total_games += part.total_games;
+        result.white_games += part.white_games;
+    }
+
+    return result;
+}
+
+std::vector<ResultRow> filter_exits(const std::vector<ResultRow> &rows,
+                                    std::optional<int> draw_rate_min,
+                                    std::optional<int> draw_rate_max, std::size_t min_games) {
+    std::vector<ResultRow> kept;
+
+    for (const auto &row : rows) {
+        const auto &stats = *row.stats;
+        const int rate    = stats.total() ? draw_percent(stats) : 0;
+
+        if (stats.total() < min_games || ((!draw_rate_min || rate >= *draw_rate_min) &&
+                                          (!draw_rate_max || rate <= *draw_rate_max))) {
+            kept.push_back(row);
+        }
+    }
+
+    return kept;
+}
+
+bool write_epd(const std::string &file, const std::vector<ResultRow> &rows) {
+    std::FILE *out = std::fopen(file.c_str(), "wb");
+    if (!out) return false;
+
+    std::vector<char> line(PositionKey::MAX_FEN_SIZE + 1);
+
+    for (const auto &row : rows) {
+        // only the FEN of a raw key can be longer
+        if (row.key->is_raw()) line.resize(std::max(line.size(), row.key->fen_capacity() + 1));
+
+        char *end = row.key->write_fen(line.data());
+        *end++    = '\n';
+        std::fwrite(line.data(), 1, end - line.data(), out);
+    }
+
+    const bool failed = std::ferror(out);
+    return std::fclose(out) == 0 && !failed;
+}
+
+bool write_histograms(const std::string &file, const PositionHistograms &histograms) {
+    // JSON only has string keys
+    const auto to_json = [](const auto &histogram) {
+        nlohmann::json j = nlohmann::json::object();
+
+        for (const auto &[value, count] : histogram) j[std::to_string(value)] = count;
+
+        return j;
+    };
+
+    const nlohmann::json j = {
+        {"positions", histograms.positions},
+        {"total_games", histograms.total_games},
+        {"white_games", histograms.white_games},
+        {"drawrate", to_json(histograms.draw_rate)},
+        {"depth", to_json(histograms.depth)},
+        {"games", to_json(histograms.games)},
+    };
+
+    std::ofstream out(file);
+    out << j.dump(2) << std::endl;
+
+    return static_cast<bool>(out);
+}
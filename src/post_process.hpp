@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "./results.hpp"
+#include "./statistics.hpp"
+
+/// @brief The positions of the written rows with all move counter variants of a position
+/// combined, as post_process_csv.py reads them from results.csv.
+struct MergedPositions {
+    std::vector<Statistics> stats;
+
+    // the key of a row is the first variant in the written order, rows point into stats
+    std::vector<ResultRow> rows;
+};
+
+/// @brief Frequencies of the draw rate (in percent), the depth (in plies, for positions
+/// with move counters) and the number of games across the positions.
+struct PositionHistograms {
+    std::map<int, std::size_t> draw_rate;
+    std::map<int, std::size_t> depth;
+    std::map<std::size_t, std::size_t> games;
+
+    std::size_t positions   = 0;
+    std::size_t total_games = 0;
+    std::size_t white_games = 0;
+};
+
+/// @brief Adds up the variants of a position which only differ in the move counters, in
+/// parallel.
+/// @param rows as written, they keep pointing into their map
+/// @param concurrency
+/// @return the positions in the order of their first variant, so that the result does not
+/// depend on the number of threads
+[[nodiscard]] MergedPositions merge_counters(const std::vector<ResultRow> &rows,
+                                             int concurrency);
+
+/// @brief Computes the histograms, every thread counts a part of the rows.
+/// @param rows
+/// @param concurrency
+/// @return
+[[nodiscard]] PositionHistograms histograms(const std::vector<ResultRow> &rows,
+                                            int concurrency);
+
+/// @brief Keeps the rows with a draw rate within the limits, or with fewer than min_games
+/// games. A draw rate is truncated to whole percent.
+/// @param rows
+/// @param draw_rate_min
+/// @param draw_rate_max
+/// @param min_games
+/// @return
+[[nodiscard]] std::vector<ResultRow> filter_exits(const std::vector<ResultRow> &rows,
+                                                  std::optional<int> draw_rate_min,
+                                                  std::optional<int> draw_rate_max,
+                                                  std::size_t min_games);
+
+/// @brief Writes the FEN of every row on its own line.
+/// @param file
+/// @param rows
+/// @return false if the file could not be written
+bool write_epd(const std::string &file, const std::vector<ResultRow> &rows);
+
+/// @brief Writes the histograms as JSON, post_process_csv.py plots them without reading the
+/// CSV file.
+/// @param file
+/// @param histograms
+/// @return false if the file could not be written
+bool write_histograms(const std::string &file, const PositionHistograms &histograms);
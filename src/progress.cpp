@@ -0,0 +1,61 @@
+#include "progress.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+ProgressReporter::ProgressReporter(std::uint64_t total_bytes, std::size_t total_jobs)
+    : total_bytes_(total_bytes), total_jobs_(total_jobs) {
+    thread_ = std::thread([this]() { run(); });
+}
+
+ProgressReporter::~ProgressReporter() { stop(); }
+
+void ProgressReporter::stop() {
+    {
+        const std::lock_guard<std::mutex> lock(mutex_);
+
+        if (stop_) return;
+        stop_ = true;
+    }
+
+    cv_.notify_one();
+    thread_.join();
+
+    print(true);
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!cv_.wait_for(lock, INTERVAL, [this]() { return stop_; })) {
+        print(false);
+    }
+}
+
+void ProgressReporter::print(bool final) const {
+    const auto bytes   = bytes_.load(std::memory_order_relaxed);
+    const auto games   = games_.load(std::memory_order_relaxed);
+    const auto jobs    = jobs_.load(std::memory_order_relaxed);
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+                             .count();
+
+    const double percent = total_bytes_ ? 100.0 * bytes / total_bytes_ : 100.0;
+    const double rate    = seconds > 0 ? bytes / seconds : 0;
+
+    char eta[32] = "";
+
+    // the average rate of the whole run gives a steadier estimate than the last interval
+    if (!final && rate > 0 && bytes < total_bytes_) {
+        const auto left = static_cast<long long>((total_bytes_ - bytes) / rate);
+        std::snprintf(eta, sizeof(eta), ", ETA %lld:%02lld", left / 60, left % 60);
+    }
+
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "\rProgress: %zu/%zu jobs, %.1f%% of %.1f MB, %.0f games/s, %.1f MB/s%s   ", jobs,
+                  total_jobs_, percent, total_bytes_ / 1e6, seconds > 0 ? games / seconds : 0.0,
+                  rate / 1e6, eta);
+
+    std::cout << line << std::flush;
+}
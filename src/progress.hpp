@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/// @brief Prints the progress of the analysis from a thread of its own, a few times per
+/// second. The workers only add to relaxed atomic counters, so reporting never makes them
+/// take a lock or wait for the console.
+class ProgressReporter {
+   public:
+    static constexpr std::chrono::milliseconds INTERVAL{500};
+
+    /// @brief Starts the reporter thread.
+    /// @param total_bytes size of all jobs on disk
+    /// @param total_jobs
+    ProgressReporter(std::uint64_t total_bytes, std::size_t total_jobs);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter &)            = delete;
+    ProgressReporter &operator=(const ProgressReporter &) = delete;
+
+    void add_bytes(std::uint64_t bytes) noexcept {
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void add_games(std::uint64_t games) noexcept {
+        games_.fetch_add(games, std::memory_order_relaxed);
+    }
+
+    void job_done() noexcept { jobs_.fetch_add(1, std::memory_order_relaxed); }
+
+    /// @brief For producers which count the bytes themselves, e.g. the readers of a Pipeline.
+    [[nodiscard]] std::atomic<std::uint64_t> &bytes() noexcept { return bytes_; }
+
+    /// @brief Stops the thread and prints the final state, without a line break.
+    void stop();
+
+   private:
+    void run();
+    void print(bool final) const;
+
+    std::uint64_t total_bytes_;
+    std::size_t total_jobs_;
+
+    std::atomic<std::uint64_t> bytes_ = 0;
+    std::atomic<std::uint64_t> games_ = 0;
+    std::atomic<std::size_t> jobs_    = 0;
+
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+/// @brief Reports the progress of one job while it is worked on. However many bytes were
+/// reported on the way, exactly size bytes are accounted once the job is done.
+class JobProgress {
+   public:
+    JobProgress(ProgressReporter *reporter, std::uint64_t size)
+        : reporter_(reporter), size_(size) {}
+
+    ~JobProgress() { update(size_, games_); }
+
+    JobProgress(const JobProgress &)            = delete;
+    JobProgress &operator=(const JobProgress &) = delete;
+
+    /// @brief Sets the bytes and the games of the job done so far.
+    /// @param bytes clamped to the size of the job
+    /// @param games
+    void update(std::uint64_t bytes, std::uint64_t games) noexcept {
+        bytes = std::min(bytes, size_);
+
+        if (reporter_) {
+            if (bytes > bytes_) reporter_->add_bytes(bytes - bytes_);
+            if (games > games_) reporter_->add_games(games - games_);
+        }
+
+        bytes_ = std::max(bytes_, bytes);
+        games_ = std::max(games_, games);
+    }
+
+   private:
+    ProgressReporter *reporter_;
+    std::uint64_t size_;
+    std::uint64_t bytes_ = 0;
+    std::uint64_t games_ = 0;
+};
@@ -0,0 +1,393 @@
+// The analysis_results module of post_process_csv.py. It maps the binary results of --binary
+// and hands the records to Python as a read-only buffer, numpy.frombuffer() views them without
+// copying. The histograms and the draw rate filter are the ones of --postProcess.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./post_process.hpp"
+#include "./result_file.hpp"
+#include "./results.hpp"
+
+namespace {
+struct ResultsObject {
+    PyObject_HEAD
+
+    ResultFile *file;
+    int concurrency;
+};
+
+PyObject *results_type = nullptr;
+
+ResultFile &file_of(PyObject *self) { return *reinterpret_cast<ResultsObject *>(self)->file; }
+
+int concurrency_of(PyObject *self) { return reinterpret_cast<ResultsObject *>(self)->concurrency; }
+
+// the rows in the order of results.csv, merge_counters() keeps the first variant it sees
+std::vector<ResultRow> rows_of(const ResultFile &file, int concurrency) {
+    std::vector<ResultRow> rows;
+    rows.reserve(file.size());
+
+    for (const auto &record : file) rows.push_back(ResultRow::of(record.key, record.stats));
+
+    sort_results(rows, 0, concurrency);
+
+    return rows;
+}
+
+// the depth of --postProcess, -1 for a position without move counters
+std::int16_t ply_of(const PositionKey &key) {
+    if (!key.has_counters()) return -1;
+
+    return static_cast<std::int16_t>((key.fullmove() - 1) * 2 + key.black_to_move());
+}
+
+template <typename HISTOGRAM>
+PyObject *to_dict(const HISTOGRAM &histogram) {
+    PyObject *dict = PyDict_New();
+    if (!dict) return nullptr;
+
+    for (const auto &[value, count] : histogram) {
+        PyObject *key   = PyLong_FromLongLong(static_cast<long long>(value));
+        PyObject *entry = PyLong_FromSize_t(count);
+
+        const bool failed = !key || !entry || PyDict_SetItem(dict, key, entry) < 0;
+
+        Py_XDECREF(key);
+        Py_XDECREF(entry);
+
+        if (failed) {
+            Py_DECREF(dict);
+            return nullptr;
+        }
+    }
+
+    return dict;
+}
+
+void results_dealloc(PyObject *self) {
+    auto *type = Py_TYPE(self);
+
+    delete reinterpret_cast<ResultsObject *>(self)->file;
+
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+int results_getbuffer(PyObject *self, Py_buffer *view, int flags) {
+    const auto &file = file_of(self);
+
+    // a buffer needs an address even if it is empty
+    static char empty = 0;
+
+    void *data = file.size() ? static_cast<void *>(const_cast<ResultRecord *>(file.begin()))
+                             : static_cast<void *>(&empty);
+
+    return PyBuffer_FillInfo(view, self, data,
+                             static_cast<Py_ssize_t>(file.size() * sizeof(ResultRecord)), 1,
+                             flags);
+}
+
+Py_ssize_t results_length(PyObject *self) { return static_cast<Py_ssize_t>(file_of(self).size()); }
+
+PyObject *results_games(PyObject *self, void *) {
+    return PyLong_FromUnsignedLongLong(file_of(self).header().games);
+}
+
+PyObject *results_fen(PyObject *self, PyObject *arg) {
+    const auto index = PyLong_AsSsize_t(arg);
+    if (index == -1 && PyErr_Occurred()) return nullptr;
+
+    const auto &file = file_of(self);
+
+    if (index < 0 || static_cast<std::size_t>(index) >= file.size()) {
+        PyErr_SetString(PyExc_IndexError, "record index out of range");
+        return nullptr;
+    }
+
+    return PyUnicode_FromString(file.begin()[index].key.to_fen().c_str());
+}
+
+PyObject *results_plies(PyObject *self, PyObject *) {
+    const auto &file = file_of(self);
+
+    PyObject *plies = PyBytes_FromStringAndSize(nullptr, file.size() * sizeof(std::int16_t));
+    if (!plies) return nullptr;
+
+    auto *out = reinterpret_cast<unsigned char *>(PyBytes_AS_STRING(plies));
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    // little endian, as the counts of the records
+    for (const auto &record : file) {
+        const auto ply = static_cast<std::uint16_t>(ply_of(record.key));
+
+        *out++ = static_cast<unsigned char>(ply & 0xff);
+        *out++ = static_cast<unsigned char>(ply >> 8);
+    }
+
+    Py_END_ALLOW_THREADS;
+
+    return plies;
+}
+
+PyObject *results_arrays(PyObject *self, PyObject *) {
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (!numpy) return nullptr;
+
+    PyObject *result  = nullptr;
+    PyObject *dtype   = Py_BuildValue("[(ss)(ss)(ss)(ss)]", "key", "V32", "wins", "<u8", "draws",
+                                      "<u8", "losses", "<u8");
+    PyObject *records = dtype ? PyObject_CallMethod(numpy, "frombuffer", "OO", self, dtype)
+                              : nullptr;
+    PyObject *plies   = records ? results_plies(self, nullptr) : nullptr;
+    PyObject *ply     = plies ? PyObject_CallMethod(numpy, "frombuffer", "Os", plies, "<i2")
+                              : nullptr;
+
+    if (ply) result = PyDict_New();
+
+    // the fields are strided views of the mapping, only the plies are computed
+    for (const char *name : {"key", "wins", "draws", "losses"}) {
+        if (!result) break;
+
+        PyObject *field = PyMapping_GetItemString(records, name);
+
+        if (!field || PyDict_SetItemString(result, name, field) < 0) Py_CLEAR(result);
+
+        Py_XDECREF(field);
+    }
+
+    if (result && PyDict_SetItemString(result, "ply", ply) < 0) Py_CLEAR(result);
+
+    Py_XDECREF(ply);
+    Py_XDECREF(plies);
+    Py_XDECREF(records);
+    Py_XDECREF(dtype);
+    Py_DECREF(numpy);
+
+    return result;
+}
+
+PyObject *results_histograms(PyObject *self, PyObject *) {
+    const auto &file       = file_of(self);
+    const auto concurrency = concurrency_of(self);
+
+    PositionHistograms counts;
+    std::string error;
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    try {
+        const auto rows = rows_of(file, concurrency);
+        counts          = histograms(merge_counters(rows, concurrency).rows, concurrency);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+
+    Py_END_ALLOW_THREADS;
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_MemoryError, error.c_str());
+        return nullptr;
+    }
+
+    // the same fields as histograms.json
+    PyObject *draw_rate = to_dict(counts.draw_rate);
+    PyObject *depth     = to_dict(counts.depth);
+    PyObject *games     = to_dict(counts.games);
+
+    PyObject *result = draw_rate && depth && games
+                           ? Py_BuildValue("{s:K,s:K,s:K,s:O,s:O,s:O}", "positions",
+                                           static_cast<unsigned long long>(counts.positions),
+                                           "total_games",
+                                           static_cast<unsigned long long>(counts.total_games),
+                                           "white_games",
+                                           static_cast<unsigned long long>(counts.white_games),
+                                           "drawrate", draw_rate, "depth", depth, "games", games)
+                           : nullptr;
+
+    Py_XDECREF(draw_rate);
+    Py_XDECREF(depth);
+    Py_XDECREF(games);
+
+    return result;
+}
+
+PyObject *results_filter_exits(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"csv_file", "draw_rate_min", "draw_rate_max",
+                                     "draw_rate_games", nullptr};
+
+    const char *csv_file = nullptr;
+    PyObject *min_arg = Py_None, *max_arg = Py_None;
+    Py_ssize_t min_games = 10;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|OOn", const_cast<char **>(keywords),
+                                     &csv_file, &min_arg, &max_arg, &min_games)) {
+        return nullptr;
+    }
+
+    std::optional<int> draw_rate_min, draw_rate_max;
+
+    if (min_arg != Py_None) draw_rate_min = static_cast<int>(PyLong_AsLong(min_arg));
+    if (max_arg != Py_None) draw_rate_max = static_cast<int>(PyLong_AsLong(max_arg));
+
+    if (PyErr_Occurred()) return nullptr;
+
+    // the .epd file is named after the .csv file, as post_process_csv.py does
+    const std::string csv = csv_file;
+    const auto epd        = csv.substr(0, csv.rfind(".csv")) + ".epd";
+
+    const auto &file       = file_of(self);
+    const auto concurrency = concurrency_of(self);
+
+    std::size_t kept_rows = 0;
+    bool written          = false;
+    std::string error;
+
+    Py_BEGIN_ALLOW_THREADS;
+
+    try {
+        const auto rows   = rows_of(file, concurrency);
+        const auto merged = merge_counters(rows, concurrency);
+
+        // in the order of the first variant, like the rows of --drawRateMin
+        const auto kept =
+            filter_exits(merged.rows, draw_rate_min, draw_rate_max,
+                         static_cast<std::size_t>(std::max<Py_ssize_t>(0, min_games)));
+
+        kept_rows = kept.size();
+        written   = write_csv(csv, kept, concurrency) && write_epd(epd, kept);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+
+    Py_END_ALLOW_THREADS;
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_MemoryError, error.c_str());
+        return nullptr;
+    }
+
+    if (!written) {
+        PyErr_Format(PyExc_OSError, "could not write %s or %s", csv.c_str(), epd.c_str());
+        return nullptr;
+    }
+
+    return PyLong_FromSize_t(kept_rows);
+}
+
+PyMethodDef results_methods[] = {
+    {"fen", results_fen, METH_O, "fen(index) -> the FEN of a record."},
+    {"plies", results_plies, METH_NOARGS,
+     "plies() -> bytes of little endian int16, the depth of each record, -1 without move "
+     "counters."},
+    {"arrays", results_arrays, METH_NOARGS,
+     "arrays() -> dict of NumPy arrays key, wins, draws, losses and ply. All but ply are views "
+     "of the mapped file."},
+    {"histograms", results_histograms, METH_NOARGS,
+     "histograms() -> dict of the histograms of --postProcess, the move counter variants of a "
+     "position combined."},
+    {"filter_exits", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(
+                         results_filter_exits)),
+     METH_VARARGS | METH_KEYWORDS,
+     "filter_exits(csv_file, draw_rate_min=None, draw_rate_max=None, draw_rate_games=10) -> "
+     "number of positions written to csv_file and the .epd file of the same name."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyGetSetDef results_getset[] = {
+    {"games", results_games, nullptr, "games of the analysis", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+PyType_Slot results_slots[] = {
+    {Py_tp_dealloc, reinterpret_cast<void *>(results_dealloc)},
+    {Py_tp_methods, results_methods},
+    {Py_tp_getset, results_getset},
+    {Py_bf_getbuffer, reinterpret_cast<void *>(results_getbuffer)},
+    {Py_sq_length, reinterpret_cast<void *>(results_length)},
+    {Py_tp_doc, const_cast<char *>("Records of a mapped result file, a read-only buffer of "
+                                   "56 byte records: a 32 byte key and three uint64 counts.")},
+    {0, nullptr},
+};
+
+PyType_Spec results_spec = {
+    "analysis_results.Results", sizeof(ResultsObject), 0, Py_TPFLAGS_DEFAULT, results_slots,
+};
+
+PyObject *module_open(PyObject *, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"path", "concurrency", nullptr};
+
+    const char *path = nullptr;
+    int concurrency  = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", const_cast<char **>(keywords), &path,
+                                     &concurrency)) {
+        return nullptr;
+    }
+
+    auto *file = new ResultFile(path);
+
+    if (!file->is_open()) {
+        delete file;
+        PyErr_Format(PyExc_OSError, "%s is not a result file", path);
+        return nullptr;
+    }
+
+    auto *results = PyObject_New(ResultsObject, reinterpret_cast<PyTypeObject *>(results_type));
+
+    if (!results) {
+        delete file;
+        return nullptr;
+    }
+
+    results->file        = file;
+    results->concurrency = concurrency > 0
+                               ? concurrency
+                               : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    return reinterpret_cast<PyObject *>(results);
+}
+
+PyMethodDef module_methods[] = {
+    {"open", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_open)),
+     METH_VARARGS | METH_KEYWORDS,
+     "open(path, concurrency=0) -> Results of a result file written with --binary."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "analysis_results",
+    "Zero-copy access to the binary results of build/src/analysis.", -1, module_methods,
+    nullptr, nullptr, nullptr, nullptr,
+};
+}  // namespace
+
+PyMODINIT_FUNC PyInit_analysis_results() {
+    PyObject *module = PyModule_Create(&module_def);
+    if (!module) return nullptr;
+
+    results_type = PyType_FromSpec(&results_spec);
+    if (!results_type) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+
+    // the module keeps its own reference, results_type stays valid for open()
+    Py_INCREF(results_type);
+
+    if (PyModule_AddObject(module, "Results", results_type) < 0) {
+        Py_DECREF(results_type);
+        Py_DECREF(module);
+        return nullptr;
+    }
+
+    return module;
+}
@@ -0,0 +1,264 @@
+#include "result_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "./binary_io.hpp"
+#include "./parallel.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// bump whenever the layout of the header or the records changes
+constexpr std::uint32_t RESULT_VERSION = 1;
+constexpr char RESULT_MAGIC[8]         = {'A', 'N', 'A', 'R', 'E', 'S', 'L', 'T'};
+
+// the layout of write_raw_fens(), read from the mapped file
+bool read_mapped_fens(std::string_view data) {
+    std::uint64_t count = 0;
+
+    if (data.size() < sizeof(count)) return false;
+
+    std::memcpy(&count, data.data(), sizeof(count));
+    data.remove_prefix(sizeof(count));
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        PositionKey key;
+        std::uint32_t size = 0;
+
+        if (data.size() < sizeof(key) + sizeof(size)) return false;
+
+        std::memcpy(&key, data.data(), sizeof(key));
+        std::memcpy(&size, data.data() + sizeof(key), sizeof(size));
+        data.remove_prefix(sizeof(key) + sizeof(size));
+
+        if (data.size() < size) return false;
+
+        PositionKey::add_raw_fen(key, data.substr(0, size));
+        data.remove_prefix(size);
+    }
+
+    return true;
+}
+}  // namespace
+
+ResultFileWriter::ResultFileWriter(const std::string &file) : file_(file), tmp_(file + ".tmp") {
+    os_.open(tmp_, std::ios::binary | std::ios::trunc);
+
+    // the header is written again once the number of records is known
+    const ResultFileHeader header = {};
+    write_pod(os_, header);
+
+    buffer_.reserve(BUFFER_RECORDS);
+}
+
+void ResultFileWriter::add(const ResultRecord &record) {
+    if (records_ % ResultFile::INDEX_STRIDE == 0) index_.push_back(record.key);
+
+    if (record.key.is_raw()) raw_.push_back(record.key);
+
+    buffer_.push_back(record);
+    records_++;
+
+    if (buffer_.size() == BUFFER_RECORDS) flush();
+}
+
+bool ResultFileWriter::finish(std::size_t games) {
+    flush();
+
+    ResultFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, RESULT_MAGIC, sizeof(RESULT_MAGIC));
+    header.version      = RESULT_VERSION;
+    header.record_size  = sizeof(ResultRecord);
+    header.records      = records_;
+    header.games        = games;
+    header.index_offset = sizeof(ResultFileHeader) + records_ * sizeof(ResultRecord);
+    header.index_stride = ResultFile::INDEX_STRIDE;
+
+    os_.write(reinterpret_cast<const char *>(index_.data()), index_.size() * sizeof(PositionKey));
+
+    // files without raw keys stay as they were, and older readers ignore the texts
+    if (!raw_.empty()) {
+        header.fens_offset = header.index_offset + index_.size() * sizeof(PositionKey);
+        write_raw_fens(os_, raw_);
+    }
+
+    os_.seekp(0);
+    write_pod(os_, header);
+    os_.close();
+
+    if (!os_) {
+        std::cerr << "Error: could not write " << file_ << std::endl;
+        return false;
+    }
+
+    // an interrupted run never leaves a truncated file behind
+    std::error_code ec;
+    fs::rename(tmp_, file_, ec);
+
+    if (ec) {
+        std::cerr << "Error: could not write " << file_ << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void ResultFileWriter::flush() {
+    os_.write(reinterpret_cast<const char *>(buffer_.data()),
+              buffer_.size() * sizeof(ResultRecord));
+    buffer_.clear();
+}
+
+bool write_result_file(const std::string &file, const map_t &stats_map, std::size_t games,
+                       int concurrency) {
+    const auto threads = static_cast<std::size_t>(std::max(1, concurrency));
+
+    // every thread collects the records of its own submaps
+    std::vector<std::vector<ResultRecord>> parts(threads);
+
+    run_threads(threads, [&](std::size_t t) {
+        for (std::size_t i = t; i < stats_map.subcnt(); i += threads) {
+            stats_map.with_submap(i, [&](const auto &set) {
+                for (const auto &[key, stats] : set) {
+                    parts[t].push_back({key, stats});
+                }
+            });
+        }
+    });
+
+    std::vector<ResultRecord> records;
+    records.reserve(stats_map.size());
+
+    for (auto &part : parts) {
+        records.insert(records.end(), part.begin(), part.end());
+        part = {};
+    }
+
+    parallel_sort(
+        records, [](const ResultRecord &a, const ResultRecord &b) { return a.key < b.key; },
+        concurrency);
+
+    ResultFileWriter writer(file);
+
+    for (const auto &record : records) {
+        writer.add(record);
+    }
+
+    return writer.finish(games);
+}
+
+bool merge_result_files(const std::string &output, const std::vector<std::string> &inputs) {
+    std::vector<std::unique_ptr<ResultFile>> files;
+    std::size_t games = 0;
+
+    for (const auto &input : inputs) {
+        files.push_back(std::make_unique<ResultFile>(input));
+
+        if (!files.back()->is_open()) {
+            std::cerr << "Error: " << input << " is not a valid result file" << std::endl;
+            return false;
+        }
+
+        games += files.back()->header().games;
+    }
+
+    // the smallest key of every input which still has records
+    using Cursor = std::pair<const ResultRecord *, std::size_t>;
+
+    const auto later = [](const Cursor &a, const Cursor &b) { return b.first->key < a.first->key; };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heads(later);
+
+    for (std::size_t i = 0; i < files.size(); i++) {
+        if (files[i]->size()) heads.emplace(files[i]->begin(), i);
+    }
+
+    ResultFileWriter writer(output);
+
+    while (!heads.empty()) {
+        ResultRecord merged = *heads.top().first;
+        bool first          = true;
+
+        // add up the records of all inputs with the same key
+        while (!heads.empty() && heads.top().first->key == merged.key) {
+            auto [record, i] = heads.top();
+            heads.pop();
+
+            if (!first) merged.stats += record->stats;
+            first = false;
+
+            if (++record != files[i]->end()) heads.emplace(record, i);
+        }
+
+        writer.add(merged);
+    }
+
+    return writer.finish(games);
+}
+
+ResultFile::ResultFile(const std::string &file) : mapped_(file) {
+    if (!mapped_.is_open()) return;
+
+    const auto view = mapped_.view();
+
+    if (view.size() < sizeof(ResultFileHeader)) return;
+
+    std::memcpy(&header_, view.data(), sizeof(header_));
+
+    const auto records_end = sizeof(ResultFileHeader) + header_.records * sizeof(ResultRecord);
+
+    if (std::memcmp(header_.magic, RESULT_MAGIC, sizeof(RESULT_MAGIC)) != 0 ||
+        header_.version != RESULT_VERSION || header_.record_size != sizeof(ResultRecord) ||
+        view.size() < records_end) {
+        return;
+    }
+
+    records_ = reinterpret_cast<const ResultRecord *>(view.data() + sizeof(ResultFileHeader));
+
+    if (header_.index_offset && header_.index_stride) {
+        index_size_ = (header_.records + header_.index_stride - 1) / header_.index_stride;
+
+        if (header_.index_offset < records_end ||
+            view.size() < header_.index_offset + index_size_ * sizeof(PositionKey)) {
+            return;
+        }
+
+        index_ = reinterpret_cast<const PositionKey *>(view.data() + header_.index_offset);
+    }
+
+    if (header_.fens_offset && (header_.fens_offset > view.size() ||
+                                !read_mapped_fens(view.substr(header_.fens_offset)))) {
+        return;
+    }
+
+    is_open_ = true;
+}
+
+const ResultRecord *ResultFile::find(const PositionKey &key) const noexcept {
+    const ResultRecord *first = begin();
+    const ResultRecord *last  = end();
+
+    // the last index entry which is not greater than key starts the block to search
+    if (index_) {
+        const auto it    = std::upper_bound(index_, index_ + index_size_, key);
+        const auto block = static_cast<std::size_t>(it - index_);
+
+        if (block == 0) return nullptr;
+
+        first = begin() + (block - 1) * header_.index_stride;
+        last  = std::min(end(), first + header_.index_stride);
+    }
+
+    const auto it = std::lower_bound(
+        first, last, key, [](const ResultRecord &r, const PositionKey &k) { return r.key < k; });
+
+    return it != last && it->key == key ? it : nullptr;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./pgn_scanner.hpp"
+#include "./position_key.hpp"
+#include "./statistics.hpp"
+
+/// @brief Binary results, a header followed by fixed-width records sorted by key and an
+/// optional sparse index which holds every INDEX_STRIDE-th key. All values are little endian,
+/// so a mapped file can be used without any parsing. The texts of the raw keys, see
+/// PositionKey::from_raw_fen(), follow at the end.
+struct ResultRecord {
+    PositionKey key;
+    Statistics stats;
+};
+
+static_assert(sizeof(ResultRecord) == 56, "the result file layout depends on the record size");
+
+struct ResultFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t records;
+    std::uint64_t games;
+
+    // byte offset of the index, 0 if there is none
+    std::uint64_t index_offset;
+    std::uint64_t index_stride;
+
+    // byte offset of the texts of the raw keys, 0 if there are none
+    std::uint64_t fens_offset;
+    std::uint64_t reserved;
+};
+
+static_assert(sizeof(ResultFileHeader) == 64, "the header keeps the records 8 byte aligned");
+
+/// @brief Writes records which are already sorted by key, they are collected in a buffer and
+/// written in large blocks. The file only appears under its name once it is complete.
+class ResultFileWriter {
+   public:
+    ResultFileWriter(const std::string &file);
+
+    void add(const ResultRecord &record);
+
+    /// @brief Writes the header and the index.
+    /// @param games
+    /// @return false if the file could not be written
+    bool finish(std::size_t games);
+
+   private:
+    static constexpr std::size_t BUFFER_RECORDS = 1 << 14;
+
+    void flush();
+
+    std::string file_;
+    std::string tmp_;
+    std::ofstream os_;
+    std::vector<ResultRecord> buffer_;
+    std::vector<PositionKey> index_;
+    std::vector<PositionKey> raw_;
+    std::uint64_t records_ = 0;
+};
+
+/// @brief Writes the statistics as result file, the records are sorted on several threads.
+/// @param file
+/// @param stats_map
+/// @param games
+/// @param concurrency
+/// @return false if the file could not be written
+bool write_result_file(const std::string &file, const map_t &stats_map, std::size_t games,
+                       int concurrency);
+
+/// @brief Combines result files with a streaming k-way merge, the statistics of equal keys are
+/// added. Only one record per input is held in memory.
+/// @param output
+/// @param inputs
+/// @return false if an input is not a valid result file or the output could not be written
+bool merge_result_files(const std::string &output, const std::vector<std::string> &inputs);
+
+/// @brief Read-only view of a memory mapped result file.
+class ResultFile {
+   public:
+    static constexpr std::uint64_t INDEX_STRIDE = 1024;
+
+    ResultFile(const std::string &file);
+
+    /// @brief False if the file cannot be mapped or has no valid header.
+    [[nodiscard]] bool is_open() const noexcept { return is_open_; }
+
+    [[nodiscard]] const ResultFileHeader &header() const noexcept { return header_; }
+
+    [[nodiscard]] const ResultRecord *begin() const noexcept { return records_; }
+    [[nodiscard]] const ResultRecord *end() const noexcept { return records_ + header_.records; }
+    [[nodiscard]] std::size_t size() const noexcept { return header_.records; }
+
+    /// @brief Binary search for key, narrowed down by the index if there is one.
+    /// @param key
+    /// @return nullptr if the key is not in the file
+    [[nodiscard]] const ResultRecord *find(const PositionKey &key) const noexcept;
+
+   private:
+    MappedFile mapped_;
+    ResultFileHeader header_     = {};
+    const ResultRecord *records_ = nullptr;
+    const PositionKey *index_    = nullptr;
+    std::size_t index_size_      = 0;
+    bool is_open_                = false;
+};
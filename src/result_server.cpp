@@ -0,0 +1,275 @@
+#include "result_server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "./fen_normalizer.hpp"
+#include "./result_file.hpp"
+#include "./results.hpp"
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__) || defined(__MACH__)
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#    define HAS_UNIX_SOCKETS 1
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+// the entries are copied submap by submap, ingesting may rehash the map at any time
+std::vector<ResultRecord> copy_records(const map_t &stats_map, std::size_t min_games) {
+    std::vector<ResultRecord> records;
+
+    for (std::size_t i = 0; i < stats_map.subcnt(); i++) {
+        stats_map.with_submap(i, [&](const auto &set) {
+            for (const auto &[key, stats] : set) {
+                if (stats.total() >= min_games) records.push_back({key, stats});
+            }
+        });
+    }
+
+    return records;
+}
+
+std::vector<ResultRow> rows_of(const std::vector<ResultRecord> &records) {
+    std::vector<ResultRow> rows;
+    rows.reserve(records.size());
+
+    for (const auto &record : records) rows.push_back(ResultRow::of(record.key, record.stats));
+
+    return rows;
+}
+
+std::string format_row(const PositionKey &key, const Statistics &stats) {
+    return key.to_fen() + ", " + std::to_string(stats.wins) + ", " + std::to_string(stats.draws) +
+           ", " + std::to_string(stats.losses) + "\n";
+}
+}  // namespace
+
+ResultServer::ResultServer(const std::string &socket_path, map_t &stats_map,
+                           const CLIOptions &options)
+    : socket_path_(socket_path), stats_map_(stats_map), options_(options) {
+#ifdef HAS_UNIX_SOCKETS
+    sockaddr_un address = {};
+    address.sun_family  = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: the socket path " << socket_path << " is too long" << std::endl;
+        return;
+    }
+
+    socket_path.copy(address.sun_path, socket_path.size());
+
+    // only a socket is replaced, never a regular file given by mistake
+    std::error_code ec;
+    if (fs::is_socket(socket_path, ec)) fs::remove(socket_path, ec);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, 16) != 0) {
+        std::cerr << "Error: could not listen on " << socket_path << std::endl;
+
+        if (listen_fd_ >= 0) close(listen_fd_);
+        listen_fd_ = -1;
+        return;
+    }
+
+    acceptor_ = std::thread([this]() { accept_clients(); });
+#else
+    std::cerr << "Error: --serve needs Unix domain sockets" << std::endl;
+#endif
+}
+
+ResultServer::~ResultServer() {
+#ifdef HAS_UNIX_SOCKETS
+    if (listen_fd_ < 0) return;
+
+    stopped_ = true;
+
+    // wakes up the blocking accept() and recv() calls
+    shutdown(listen_fd_, SHUT_RDWR);
+    acceptor_.join();
+
+    {
+        const std::lock_guard<std::mutex> lock(clients_mutex_);
+
+        for (const int fd : client_fds_) shutdown(fd, SHUT_RDWR);
+    }
+
+    for (auto &client : clients_) client.join();
+
+    close(listen_fd_);
+
+    std::error_code ec;
+    fs::remove(socket_path_, ec);
+#endif
+}
+
+void ResultServer::accept_clients() {
+#ifdef HAS_UNIX_SOCKETS
+    while (true) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        const std::lock_guard<std::mutex> lock(clients_mutex_);
+
+        reap_clients();
+
+        client_fds_.push_back(fd);
+        clients_.emplace_back([this, fd]() { serve_client(fd); });
+    }
+#endif
+}
+
+void ResultServer::reap_clients() {
+    // a finished client only has to return from serve_client(), so the join is short
+    for (const auto id : finished_) {
+        const auto it = std::find_if(clients_.begin(), clients_.end(), [id](const auto &client) {
+            return client.get_id() == id;
+        });
+
+        if (it == clients_.end()) continue;
+
+        it->join();
+        clients_.erase(it);
+    }
+
+    finished_.clear();
+}
+
+void ResultServer::serve_client(int fd) {
+#ifdef HAS_UNIX_SOCKETS
+    std::string pending;
+    char buffer[4096];
+    ssize_t length;
+
+    while ((length = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        pending.append(buffer, length);
+
+        std::size_t end;
+
+        while ((end = pending.find('\n')) != std::string::npos) {
+            auto request = pending.substr(0, end);
+            pending.erase(0, end + 1);
+
+            if (!request.empty() && request.back() == '\r') request.pop_back();
+
+            const auto response = answer(request);
+
+            for (std::size_t sent = 0; sent < response.size();) {
+                const auto n = send(fd, response.data() + sent, response.size() - sent,
+#    ifdef MSG_NOSIGNAL
+                                    MSG_NOSIGNAL
+#    else
+                                    0
+#    endif
+                );
+
+                if (n <= 0) break;
+                sent += n;
+            }
+        }
+    }
+
+    // the descriptor is gone before it could be reused by another client, and the next accept
+    // joins this thread
+    const std::lock_guard<std::mutex> lock(clients_mutex_);
+
+    client_fds_.erase(std::find(client_fds_.begin(), client_fds_.end(), fd));
+    close(fd);
+
+    finished_.push_back(std::this_thread::get_id());
+#else
+    (void)fd;
+#endif
+}
+
+std::string ResultServer::answer(const std::string &request) {
+    const auto space    = request.find(' ');
+    const auto command  = request.substr(0, space);
+    const auto argument = space == std::string::npos ? std::string() : request.substr(space + 1);
+
+    if (command == "fen") {
+        bool missing   = false;
+        const auto key = normalize_fen(argument, options_.fixfens, missing);
+
+        if (!key) return "error the position is not in fixFENsource\n";
+
+        Statistics stats;
+        const bool found = stats_map_.if_contains(
+            *key, [&](const map_t::value_type &entry) { stats = entry.second; });
+
+        return found ? "ok 1\n" + format_row(*key, stats) : "ok 0\n";
+    }
+
+    if (command == "top") {
+        std::size_t n = 0;
+
+        try {
+            n = std::stoull(argument);
+        } catch (const std::exception &) {
+            return "error top expects a number\n";
+        }
+
+        // 0 would mean all positions to sort_results(), results.csv has at most --topN
+        if (n == 0) return "error top expects a number greater than 0\n";
+
+        if (options_.top_n) n = std::min(n, options_.top_n);
+
+        const auto records = copy_records(stats_map_, options_.min_games);
+        auto rows          = rows_of(records);
+
+        sort_results(rows, n, options_.concurrency);
+
+        std::string response = "ok " + std::to_string(rows.size()) + "\n";
+
+        for (const auto &row : rows) response += format_row(*row.key, *row.stats);
+
+        return response;
+    }
+
+    if (command == "snapshot") {
+        if (argument.empty()) return "error snapshot expects a file\n";
+
+        const auto records = copy_records(stats_map_, options_.min_games);
+        auto rows          = rows_of(records);
+
+        sort_results(rows, options_.top_n, options_.concurrency);
+
+        if (!write_csv(argument, rows, options_.concurrency)) {
+            return "error could not write " + argument + "\n";
+        }
+
+        return "ok 0\n";
+    }
+
+    if (command == "status") {
+        std::size_t positions = 0;
+
+        for (std::size_t i = 0; i < stats_map_.subcnt(); i++) {
+            stats_map_.with_submap(i, [&](const auto &set) { positions += set.size(); });
+        }
+
+        return "ok 1\nfiles " + std::to_string(files_) + ", games " + std::to_string(games_) +
+               ", positions " + std::to_string(positions) + "\n";
+    }
+
+    if (command == "shutdown") {
+        stopped_ = true;
+        return "ok 0\n";
+    }
+
+    return "error unknown command " + command + "\n";
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./options.hpp"
+#include "./statistics.hpp"
+
+/// @brief Answers queries on the live map of --serve over a Unix domain socket. Every client
+/// gets its own thread, a query only ever holds the lock of one submap at a time, so lookups
+/// stay fast while files are ingested. Requests and responses are lines of text:
+///
+///   fen <FEN>        ok 1 and "FEN, Wins, Draws, Losses", or ok 0 if the position is unknown
+///   top <n>          ok <k> and the first k <= n lines of results.csv, n > 0
+///   snapshot <file>  ok 0 once the file is written like results.csv
+///   status           ok 1 and the numbers of files, games and positions
+///   shutdown         ok 0, the service ends after the current ingest
+///
+/// A request which cannot be answered gets "error <message>".
+class ResultServer {
+   public:
+    /// @brief Listens on the socket, a stale socket file of an earlier run is replaced.
+    /// @param socket_path
+    /// @param stats_map
+    /// @param options the move counters of --fixFENsource are applied to a queried FEN
+    ResultServer(const std::string &socket_path, map_t &stats_map, const CLIOptions &options);
+    ~ResultServer();
+
+    ResultServer(const ResultServer &)            = delete;
+    ResultServer &operator=(const ResultServer &) = delete;
+
+    [[nodiscard]] bool is_open() const noexcept { return listen_fd_ >= 0; }
+
+    /// @brief True once a client asked for a shutdown.
+    [[nodiscard]] bool stopped() const noexcept { return stopped_; }
+
+    /// @brief Updates the numbers reported by status.
+    /// @param files
+    /// @param games
+    void set_status(std::size_t files, std::size_t games) {
+        files_ = files;
+        games_ = games;
+    }
+
+   private:
+    void accept_clients();
+    void serve_client(int fd);
+
+    /// @brief Joins the threads of the clients which disconnected, with clients_mutex_ held.
+    void reap_clients();
+
+    [[nodiscard]] std::string answer(const std::string &request);
+
+    std::string socket_path_;
+    map_t &stats_map_;
+    const CLIOptions &options_;
+
+    int listen_fd_ = -1;
+    std::atomic<bool> stopped_{false};
+    std::atomic<std::size_t> files_{0};
+    std::atomic<std::size_t> games_{0};
+
+    std::thread acceptor_;
+
+    std::mutex clients_mutex_;
+    std::vector<int> client_fds_;
+    std::vector<std::thread> clients_;
+    std::vector<std::thread::id> finished_;
+};
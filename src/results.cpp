@@ -0,0 +1,277 @@
+#include "results.hpp"
+
+#include <zlib.h>
+
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./parallel.hpp"
+
+namespace {
+// rows per formatted block, and the longest line a row of a packed key can produce
+constexpr std::size_t BLOCK_ROWS = 1 << 16;
+constexpr std::size_t MAX_LINE   = PositionKey::MAX_FEN_SIZE + 3 * 22 + 1;
+
+char *write_number(char *out, std::size_t value) {
+    return std::to_chars(out, out + 20, value).ptr;
+}
+
+// the FEN of a raw key may be longer than the one of any packed key
+std::size_t block_size(const ResultRow *first, const ResultRow *last) {
+    auto size = static_cast<std::size_t>(last - first) * MAX_LINE;
+
+    for (; first != last; ++first) {
+        if (first->key->is_raw()) size += first->key->fen_capacity();
+    }
+
+    return size;
+}
+
+std::size_t format_rows(const ResultRow *first, const ResultRow *last, char *out) {
+    char *p = out;
+
+    for (; first != last; ++first) {
+        const auto &stats = *first->stats;
+
+        p    = first->key->write_fen(p);
+        *p++ = ',';
+        *p++ = ' ';
+        p    = write_number(p, stats.wins);
+        *p++ = ',';
+        *p++ = ' ';
+        p    = write_number(p, stats.draws);
+        *p++ = ',';
+        *p++ = ' ';
+        p    = write_number(p, stats.losses);
+        *p++ = '\n';
+    }
+
+    return p - out;
+}
+
+std::size_t packed_capacity(Compression compression, std::size_t size) {
+    // the gzip header and trailer are 12 bytes longer than the ones of zlib
+    if (compression == Compression::GZIP) return compressBound(size) + 12;
+
+#ifdef HAS_ZSTD
+    if (compression == Compression::ZSTD) return ZSTD_compressBound(size);
+#endif
+
+    return 0;
+}
+
+// every block becomes a gzip member or a zstd frame of its own, readers of both formats take
+// a sequence of them as one stream
+std::size_t compress_block(Compression compression, const char *data, std::size_t size,
+                           char *out, std::size_t capacity) {
+    if (compression == Compression::GZIP) {
+        z_stream zs = {};
+
+        // 16 added to the window bits writes a gzip header instead of a zlib one
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            return 0;
+        }
+
+        zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in  = static_cast<uInt>(size);
+        zs.next_out  = reinterpret_cast<Bytef *>(out);
+        zs.avail_out = static_cast<uInt>(capacity);
+
+        const int status    = deflate(&zs, Z_FINISH);
+        const auto produced = capacity - zs.avail_out;
+
+        deflateEnd(&zs);
+
+        return status == Z_STREAM_END ? produced : 0;
+    }
+
+#ifdef HAS_ZSTD
+    if (compression == Compression::ZSTD) {
+        const auto produced = ZSTD_compress(out, capacity, data, size, ZSTD_CLEVEL_DEFAULT);
+
+        return ZSTD_isError(produced) ? 0 : produced;
+    }
+#endif
+
+    return 0;
+}
+}  // namespace
+
+Compression compression_of(const std::string &file) {
+    const auto ends_with = [&file](const char *suffix) {
+        const auto length = std::strlen(suffix);
+        return file.size() >= length && file.compare(file.size() - length, length, suffix) == 0;
+    };
+
+    if (ends_with(".gz")) return Compression::GZIP;
+    if (ends_with(".zst")) return Compression::ZSTD;
+
+    return Compression::NONE;
+}
+
+bool row_before(const ResultRow &a, const ResultRow &b) {
+    if (a.draw_rate != b.draw_rate) return a.draw_rate < b.draw_rate;
+    if (a.total != b.total) return a.total > b.total;
+
+    // with equal draw rate and total, the wins decide the rest
+    if (a.stats->wins != b.stats->wins) return a.stats->wins > b.stats->wins;
+
+    return *a.key < *b.key;
+}
+
+void sort_results(std::vector<ResultRow> &rows, std::size_t top_n, int concurrency) {
+    // only the first top_n rows have to be in order
+    if (top_n && top_n < rows.size()) {
+        std::nth_element(rows.begin(), rows.begin() + top_n, rows.end(), row_before);
+        rows.resize(top_n);
+    }
+
+    parallel_sort(rows, row_before, concurrency, BLOCK_ROWS);
+}
+
+std::vector<ResultRow> sorted_results(const map_t &stats_map, std::size_t min_games,
+                                      std::size_t top_n, int concurrency) {
+    const auto threads = static_cast<std::size_t>(std::max(1, concurrency));
+
+    // every thread collects the rows of its own submaps
+    std::vector<std::vector<ResultRow>> parts(threads);
+
+    run_threads(threads, [&](std::size_t t) {
+        for (std::size_t i = t; i < stats_map.subcnt(); i += threads) {
+            stats_map.with_submap(i, [&](const auto &set) {
+                for (const auto &[key, stats] : set) {
+                    if (stats.total() < min_games) continue;
+
+                    parts[t].push_back(ResultRow::of(key, stats));
+                }
+            });
+        }
+    });
+
+    std::vector<ResultRow> rows;
+    std::size_t count = 0;
+
+    for (const auto &part : parts) count += part.size();
+
+    rows.reserve(count);
+
+    for (auto &part : parts) {
+        rows.insert(rows.end(), part.begin(), part.end());
+        part = {};
+    }
+
+    sort_results(rows, top_n, concurrency);
+
+    return rows;
+}
+
+CsvWriter::CsvWriter(const std::string &file, int concurrency)
+    : compression_(compression_of(file)),
+      threads_(static_cast<std::size_t>(std::max(1, concurrency))),
+      blocks_(threads_),
+      block_capacities_(threads_),
+      sizes_(threads_),
+      packed_(threads_),
+      packed_capacities_(threads_) {
+    if (compression_ == Compression::ZSTD && !ZSTD_SUPPORTED) return;
+
+    out_ = std::fopen(file.c_str(), "wb");
+    if (!out_) return;
+
+    const std::string header = "FEN, Wins, Draws, Losses\n";
+    reserve(0, header.size());
+    std::memcpy(blocks_[0].get(), header.data(), header.size());
+
+    std::fwrite(output(0), 1, pack(0, header.size()), out_);
+}
+
+CsvWriter::~CsvWriter() {
+    if (out_) std::fclose(out_);
+}
+
+void CsvWriter::write(const std::vector<ResultRow> &rows) {
+    if (rows.empty()) return;
+
+    // a few rows are formatted in small blocks on as many threads as there are blocks, so
+    // that the buffers follow the size of the output and not the number of threads
+    const auto block_rows = std::min(BLOCK_ROWS, (rows.size() + threads_ - 1) / threads_);
+    const auto blocks     = std::min(threads_, (rows.size() + block_rows - 1) / block_rows);
+
+    // a batch of blocks is formatted in parallel, then written in order
+    for (std::size_t first = 0; first < rows.size(); first += blocks * block_rows) {
+        run_threads(blocks, [&](std::size_t t) {
+            const auto begin = std::min(rows.size(), first + t * block_rows);
+            const auto end   = std::min(rows.size(), begin + block_rows);
+
+            reserve(t, block_size(rows.data() + begin, rows.data() + end));
+
+            sizes_[t] =
+                pack(t, format_rows(rows.data() + begin, rows.data() + end, blocks_[t].get()));
+        });
+
+        for (std::size_t t = 0; t < blocks; t++) {
+            std::fwrite(output(t), 1, sizes_[t], out_);
+        }
+    }
+}
+
+void CsvWriter::reserve(std::size_t t, std::size_t size) {
+    // not value-initialized, the writers only read what they formatted
+    if (block_capacities_[t] < size) {
+        blocks_[t].reset(new char[size]);
+        block_capacities_[t] = size;
+    }
+
+    if (compression_ == Compression::NONE) return;
+
+    const auto capacity = packed_capacity(compression_, size);
+
+    if (packed_capacities_[t] < capacity) {
+        packed_[t].reset(new char[capacity]);
+        packed_capacities_[t] = capacity;
+    }
+}
+
+std::size_t CsvWriter::pack(std::size_t t, std::size_t size) {
+    if (compression_ == Compression::NONE || size == 0) return size;
+
+    const auto packed = compress_block(compression_, blocks_[t].get(), size, packed_[t].get(),
+                                       packed_capacities_[t]);
+
+    if (packed == 0) failed_ = true;
+
+    return packed;
+}
+
+const char *CsvWriter::output(std::size_t t) const noexcept {
+    return compression_ == Compression::NONE ? blocks_[t].get() : packed_[t].get();
+}
+
+bool CsvWriter::close() {
+    if (!out_) return false;
+
+    const bool failed = std::ferror(out_);
+    const bool closed = std::fclose(out_) == 0;
+    out_              = nullptr;
+
+    return closed && !failed && !failed_;
+}
+
+bool write_csv(const std::string &file, const std::vector<ResultRow> &rows, int concurrency) {
+    CsvWriter writer(file, concurrency);
+    if (!writer.is_open()) return false;
+
+    writer.write(rows);
+
+    return writer.close();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./statistics.hpp"
+
+// builds with libzstd, see the zstd option, write .zst files as well
+#ifdef HAS_ZSTD
+constexpr bool ZSTD_SUPPORTED = true;
+#else
+constexpr bool ZSTD_SUPPORTED = false;
+#endif
+
+enum class Compression { NONE, GZIP, ZSTD };
+
+/// @brief The compression of an output file by its name, .gz or .zst.
+/// @param file
+/// @return
+[[nodiscard]] Compression compression_of(const std::string &file);
+
+/// @brief Row of the output, refers to the entry of a map or a result file instead of copying
+/// it. The draw rate and the number of games are computed once, so that sorting only
+/// compares numbers.
+struct ResultRow {
+    double draw_rate;
+    std::size_t total;
+    const PositionKey *key;
+    const Statistics *stats;
+
+    [[nodiscard]] static ResultRow of(const PositionKey &key, const Statistics &stats) {
+        return {stats.draw_rate(), stats.total(), &key, &stats};
+    }
+};
+
+/// @brief Order of the output, the same as Statistics::operator< with the key deciding between
+/// equal statistics.
+[[nodiscard]] bool row_before(const ResultRow &a, const ResultRow &b);
+
+/// @brief Sorts the rows like Statistics::operator<, equal statistics are ordered by their key.
+/// @param rows
+/// @param top_n if not 0, only the first top_n rows are sorted and kept
+/// @param concurrency
+void sort_results(std::vector<ResultRow> &rows, std::size_t top_n, int concurrency);
+
+/// @brief Collects the entries with at least min_games games and sorts them with sort_results.
+/// @param stats_map has to stay unchanged while the rows are used
+/// @param min_games
+/// @param top_n
+/// @param concurrency
+/// @return
+[[nodiscard]] std::vector<ResultRow> sorted_results(const map_t &stats_map, std::size_t min_games,
+                                                    std::size_t top_n, int concurrency);
+
+/// @brief Writes "FEN, Wins, Draws, Losses" lines, rows are added in batches which are
+/// formatted in large blocks on several threads. A file named .gz or .zst is compressed, each
+/// block by the thread which formatted it, and the blocks are written in order.
+class CsvWriter {
+   public:
+    /// @param file not opened if it is a .zst file and ZSTD_SUPPORTED is false
+    /// @param concurrency
+    CsvWriter(const std::string &file, int concurrency);
+    ~CsvWriter();
+
+    CsvWriter(const CsvWriter &)            = delete;
+    CsvWriter &operator=(const CsvWriter &) = delete;
+
+    [[nodiscard]] bool is_open() const noexcept { return out_ != nullptr; }
+
+    void write(const std::vector<ResultRow> &rows);
+
+    /// @brief Closes the file.
+    /// @return false if it could not be written
+    bool close();
+
+   private:
+    /// @brief Compresses the formatted block of thread t, unless the file is plain.
+    /// @param t
+    /// @param size of the formatted block
+    /// @return the bytes of output(t) to write
+    std::size_t pack(std::size_t t, std::size_t size);
+
+    [[nodiscard]] const char *output(std::size_t t) const noexcept;
+
+    /// @brief Grows the buffers of thread t for a block of size bytes, and for its compressed
+    /// form.
+    /// @param t
+    /// @param size
+    void reserve(std::size_t t, std::size_t size);
+
+    Compression compression_;
+    std::FILE *out_ = nullptr;
+    std::size_t threads_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<std::size_t> block_capacities_;
+    std::vector<std::size_t> sizes_;
+
+    // the compressed blocks, never allocated for a plain file
+    std::vector<std::unique_ptr<char[]>> packed_;
+    std::vector<std::size_t> packed_capacities_;
+    std::atomic<bool> failed_ = false;
+};
+
+/// @brief Writes the rows as "FEN, Wins, Draws, Losses" lines, they are formatted in large
+/// blocks on several threads. The name decides the compression, as for CsvWriter.
+/// @param file
+/// @param rows
+/// @param concurrency
+/// @return false if the file could not be written
+bool write_csv(const std::string &file, const std::vector<ResultRow> &rows, int concurrency);
@@ -0,0 +1,201 @@
+#include "run_stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "./alloc_counter.hpp"
+
+namespace {
+// the counters of every thread that ever asked for them, they outlive their threads
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadStats>> registry;
+
+// the counters of the threads which ended, a new thread of the same role takes them over
+std::vector<ThreadStats *> released;
+
+// hands the counters of the thread back once the thread ends
+struct ThreadSlot {
+    ThreadStats *stats = nullptr;
+
+    ~ThreadSlot() {
+        if (!stats) return;
+
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+        released.push_back(stats);
+    }
+};
+
+thread_local ThreadSlot slot;
+
+void add_times(nlohmann::json &j, const ThreadStats &stats) {
+    j["busy"]    = j.value("busy", 0.0) + stats.busy;
+    j["idle"]    = j.value("idle", 0.0) + stats.idle;
+    j["read"]    = j.value("read", 0.0) + stats.read;
+    j["inflate"] = j.value("inflate", 0.0) + stats.inflate;
+    // the parse time of a file includes the inserts of its games
+    j["parse"]   = j.value("parse", 0.0) + stats.parse - stats.insert;
+    j["insert"]  = j.value("insert", 0.0) + stats.insert;
+}
+}  // namespace
+
+ThreadStats &thread_stats() {
+    if (!slot.stats) {
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadStats>());
+        slot.stats = registry.back().get();
+    }
+
+    return *slot.stats;
+}
+
+ThreadStats &thread_stats(const std::string &role) {
+    if (slot.stats) {
+        slot.stats->role = role;
+        return *slot.stats;
+    }
+
+    const std::lock_guard<std::mutex> lock(registry_mutex);
+
+    const auto it = std::find_if(released.begin(), released.end(),
+                                 [&role](const ThreadStats *stats) { return stats->role == role; });
+
+    if (it != released.end()) {
+        slot.stats = *it;
+        released.erase(it);
+    } else {
+        registry.push_back(std::make_unique<ThreadStats>());
+        slot.stats       = registry.back().get();
+        slot.stats->role = role;
+    }
+
+    return *slot.stats;
+}
+
+double RunStats::allocations_per_game() {
+    std::uint64_t allocations = 0;
+    std::uint64_t games       = 0;
+
+    const std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (const auto &stats : registry) {
+        allocations += stats->game_allocations;
+        games += stats->measured_games;
+    }
+
+    return games ? double(allocations) / games : 0.0;
+}
+
+bool RunStats::write(const std::string &file) const {
+    nlohmann::json j = info_;
+
+    auto &stages = j["stages"];
+    stages       = nlohmann::json::object();
+
+    // a stage which ran in several steps is reported once
+    for (const auto &[name, seconds] : stages_) {
+        stages[name] = stages.value(name, 0.0) + seconds;
+    }
+
+    ThreadStats total;
+    std::map<std::string, TerminationCount> terminations;
+    std::map<std::string, nlohmann::json> roles;
+    std::map<int, nlohmann::json> nodes;
+
+    {
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+
+        for (const auto &stats : registry) {
+            total.compressed_bytes += stats->compressed_bytes;
+            total.decompressed_bytes += stats->decompressed_bytes;
+            total.parsed_bytes += stats->parsed_bytes;
+            total.files += stats->files;
+            total.filtered += stats->filtered;
+            total.no_result += stats->no_result;
+            total.invalid_tree_position += stats->invalid_tree_position;
+
+            for (const auto &count : stats->terminations) {
+                auto &sum = terminations[count.reason];
+                sum.accepted += count.accepted;
+                sum.rejected += count.rejected;
+            }
+
+            // threads of the same role are summed up, e.g. all parsers of the pipeline
+            const auto name = stats->role.empty() ? "other" : stats->role;
+
+            auto &role      = roles.try_emplace(name, nlohmann::json::object()).first->second;
+            role["threads"] = role.value("threads", 0) + 1;
+            add_times(role, *stats);
+
+            nlohmann::json thread = {{"role", name}};
+            add_times(thread, *stats);
+            thread["files"] = stats->files;
+
+            if (stats->numa_node >= 0) {
+                thread["numa_node"] = stats->numa_node;
+
+                std::uint64_t games = 0;
+                for (const auto &count : stats->terminations) games += count.accepted;
+
+                auto &node = nodes.try_emplace(stats->numa_node, nlohmann::json::object())
+                                 .first->second;
+                node["threads"]      = node.value("threads", 0) + 1;
+                node["busy"]         = node.value("busy", 0.0) + stats->busy;
+                node["games"]        = node.value("games", std::uint64_t(0)) + games;
+                node["parsed_bytes"] = node.value("parsed_bytes", std::uint64_t(0)) +
+                                       stats->parsed_bytes;
+            }
+
+            j["threads"].push_back(thread);
+        }
+    }
+
+    j["bytes"] = {{"compressed", total.compressed_bytes},
+                  {"decompressed", total.decompressed_bytes},
+                  {"parsed", total.parsed_bytes}};
+
+    std::uint64_t accepted = 0;
+    std::uint64_t rejected = total.filtered + total.no_result;
+
+    for (const auto &[reason, count] : terminations) {
+        j["games"]["termination"][reason.empty() ? "none" : reason] = {
+            {"accepted", count.accepted}, {"rejected", count.rejected}};
+
+        accepted += count.accepted;
+        rejected += count.rejected;
+    }
+
+    j["files"]["parsed"] = total.files;
+
+    j["games"]["accepted"]  = accepted;
+    j["games"]["rejected"]  = rejected;
+    j["games"]["filtered"]  = total.filtered;
+    j["games"]["no_result"] = total.no_result;
+
+    if (total.invalid_tree_position) {
+        j["games"]["invalid_tree_position"] = total.invalid_tree_position;
+    }
+
+    if constexpr (COUNTS_ALLOCATIONS) j["games"]["allocations_per_game"] = allocations_per_game();
+
+    for (const auto &[name, role] : roles) {
+        j["roles"][name] = role;
+    }
+
+    // the games per busy second of a thread, equal on every node if the nodes scale
+    for (auto &[index, node] : nodes) {
+        const double busy = node["busy"];
+
+        node["games_per_thread_second"] = busy > 0 ? node["games"].get<double>() / busy : 0.0;
+        j["numa"]["nodes"][std::to_string(index)] = node;
+    }
+
+    std::ofstream os(file);
+    os << j.dump(4) << std::endl;
+
+    return static_cast<bool>(os);
+}
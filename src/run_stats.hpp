@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../external/json.hpp"
+#include "./trace.hpp"
+
+/// @brief Measures the time between laps.
+class Stopwatch {
+   public:
+    /// @brief Seconds since the previous lap, or since construction.
+    double lap() {
+        const auto now     = std::chrono::steady_clock::now();
+        const auto seconds = std::chrono::duration<double>(now - last_).count();
+        last_              = now;
+        return seconds;
+    }
+
+   private:
+    std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+};
+
+/// @brief Games of one Termination tag value, an empty value is a game without the tag.
+struct TerminationCount {
+    std::string reason;
+    std::uint64_t accepted = 0;
+    std::uint64_t rejected = 0;
+};
+
+/// @brief Counters of one thread. A thread only ever writes its own counters, so collecting
+/// them needs neither locks nor atomics. They are added up once the threads are done.
+struct ThreadStats {
+    // "worker", "reader", "inflater", "parser" or "main"
+    std::string role;
+
+    // the node a worker of --numa is pinned to, -1 for a thread which is not pinned
+    int numa_node = -1;
+
+    // seconds
+    double busy    = 0;
+    double idle    = 0;
+    double read    = 0;
+    double inflate = 0;
+    double parse   = 0;
+    double insert  = 0;
+
+    std::uint64_t compressed_bytes   = 0;
+    std::uint64_t decompressed_bytes = 0;
+    std::uint64_t parsed_bytes       = 0;
+    std::uint64_t files              = 0;
+
+    // games rejected before the Termination tag is looked at
+    std::uint64_t filtered  = 0;
+    std::uint64_t no_result = 0;
+
+    // games of --treeDepth which are counted, but whose position cannot be replayed
+    std::uint64_t invalid_tree_position = 0;
+
+    // heap allocations from the start to the end of each game, only in builds which count them
+    std::uint64_t game_allocations = 0;
+    std::uint64_t measured_games   = 0;
+
+    std::vector<TerminationCount> terminations;
+
+    void count_game(std::string_view termination, bool accepted) {
+        auto it = terminations.begin();
+
+        // only a handful of distinct values exist, a linear search beats hashing them
+        while (it != terminations.end() && it->reason != termination) ++it;
+
+        if (it == terminations.end()) {
+            terminations.push_back({std::string(termination)});
+            it = terminations.end() - 1;
+        }
+
+        (accepted ? it->accepted : it->rejected)++;
+    }
+};
+
+/// @brief The counters of the calling thread, a thread registers them on its first call.
+/// @return stays valid after the thread ended
+ThreadStats &thread_stats();
+
+/// @brief The counters of the calling thread, which starts a thread of role. It continues the
+/// counters of a thread of the same role which ended, so that threads which are started again
+/// and again, e.g. the workers of every ingest of --serve, do not add ever more counters.
+/// @param role
+/// @return stays valid after the thread ended
+ThreadStats &thread_stats(const std::string &role);
+
+/// @brief Timings of the main thread and the totals of all threads, written with --stats.
+class RunStats {
+   public:
+    /// @brief Records a stage of the run, the times of a stage with several steps are added.
+    /// With --trace the stage is a span of the calling thread as well.
+    /// @param name a string literal
+    /// @param seconds
+    void stage(const char *name, double seconds) {
+        stages_.emplace_back(name, seconds);
+
+        if (Trace::enabled()) Trace::add_ending_now(name, seconds);
+    }
+
+    /// @brief Values which are only known to the caller, e.g. the number of files.
+    nlohmann::json &info() { return info_; }
+
+    /// @brief Adds up the counters of all threads, all of them have to be done.
+    /// @param file
+    /// @return false if the file could not be written
+    bool write(const std::string &file) const;
+
+    /// @brief Heap allocations per game of all threads so far, 0 in builds which do not count
+    /// them. Rehashes of the maps are included, once they stopped growing a game should not
+    /// allocate at all.
+    [[nodiscard]] static double allocations_per_game();
+
+   private:
+    std::vector<std::pair<std::string, double>> stages_;
+    nlohmann::json info_ = nlohmann::json::object();
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "./run_stats.hpp"
+
+/// @brief Runs a fixed set of jobs on a number of threads. The jobs are dealt out round-robin
+/// to one deque per worker, in the order given. A worker takes jobs from the front of its own
+/// deque and, once that is empty, steals from the back of the other deques. Handing in the
+/// jobs largest first therefore starts the big jobs early and leaves the small ones for
+/// balancing the tail.
+class WorkStealingScheduler {
+   public:
+    using Job = std::function<void(std::size_t worker)>;
+
+    WorkStealingScheduler(std::size_t num_threads)
+        : queues_(std::max<std::size_t>(1, num_threads)) {
+        for (auto &queue : queues_) {
+            queue = std::make_unique<Queue>();
+        }
+    }
+
+    /// @brief Sets a function which every worker thread calls before its first job, e.g. to
+    /// pin the thread.
+    /// @param init
+    void on_start(std::function<void(std::size_t worker)> init) { init_ = std::move(init); }
+
+    /// @brief Blocks until all jobs are done.
+    /// @param jobs
+    void run(std::vector<Job> jobs) {
+        for (std::size_t i = 0; i < jobs.size(); i++) {
+            queues_[i % queues_.size()]->jobs.push_back(std::move(jobs[i]));
+        }
+
+        std::vector<std::thread> workers;
+        std::vector<ThreadStats *> stats(queues_.size());
+        std::vector<double> busy(queues_.size());
+        Stopwatch watch;
+
+        for (std::size_t i = 0; i < queues_.size(); i++) {
+            workers.emplace_back([this, i, &stats, &busy]() {
+                stats[i] = &thread_stats("worker");
+
+                if (init_) init_(i);
+
+                busy[i] = work(i);
+            });
+        }
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        // a worker which ran out of jobs is idle until the last one is done, its counters are
+        // only taken over by the workers of a later run
+        const auto seconds = watch.lap();
+
+        for (std::size_t i = 0; i < stats.size(); i++) {
+            stats[i]->busy += busy[i];
+            stats[i]->idle += seconds - busy[i];
+        }
+    }
+
+   private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::optional<Job> pop(std::size_t worker) {
+        auto &queue = *queues_[worker];
+        const std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.jobs.empty()) return std::nullopt;
+
+        auto job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        return job;
+    }
+
+    std::optional<Job> steal(std::size_t worker) {
+        for (std::size_t i = 1; i < queues_.size(); i++) {
+            auto &queue = *queues_[(worker + i) % queues_.size()];
+            const std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (queue.jobs.empty()) continue;
+
+            auto job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            return job;
+        }
+
+        return std::nullopt;
+    }
+
+    // returns the seconds spent in jobs
+    double work(std::size_t worker) {
+        double busy = 0;
+
+        // no jobs are added while running, so all deques being empty means we are done
+        while (true) {
+            auto job = pop(worker);
+
+            if (!job) job = steal(worker);
+
+            if (!job) return busy;
+
+            Stopwatch watch;
+            (*job)(worker);
+            busy += watch.lap();
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::function<void(std::size_t worker)> init_;
+};
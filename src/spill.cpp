@@ -0,0 +1,340 @@
+#include "spill.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "./parallel.hpp"
+#include "./results.hpp"
+#include "./run_stats.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// records buffered per run while merging, so that many runs still need little memory
+constexpr std::size_t READ_RECORDS = 1 << 12;
+
+// rows handed to the CSV writer at once
+constexpr std::size_t WRITE_ROWS = 1 << 18;
+
+class RunReader {
+   public:
+    RunReader(const std::string &file)
+        : in_(std::fopen(file.c_str(), "rb")), buffer_(READ_RECORDS) {
+        fill();
+    }
+
+    ~RunReader() {
+        if (in_) std::fclose(in_);
+    }
+
+    RunReader(const RunReader &)            = delete;
+    RunReader &operator=(const RunReader &) = delete;
+
+    [[nodiscard]] bool is_open() const noexcept { return in_ != nullptr; }
+
+    /// @brief The current record, nullptr at the end of the run.
+    [[nodiscard]] const ResultRecord *peek() const noexcept {
+        return pos_ < size_ ? &buffer_[pos_] : nullptr;
+    }
+
+    void next() {
+        if (++pos_ == size_) fill();
+    }
+
+   private:
+    void fill() {
+        size_ = in_ ? std::fread(buffer_.data(), sizeof(ResultRecord), buffer_.size(), in_) : 0;
+        pos_  = 0;
+    }
+
+    std::FILE *in_;
+    std::vector<ResultRecord> buffer_;
+    std::size_t pos_  = 0;
+    std::size_t size_ = 0;
+};
+
+bool key_before(const ResultRecord &a, const ResultRecord &b) { return a.key < b.key; }
+
+bool output_before(const ResultRecord &a, const ResultRecord &b) {
+    return row_before(ResultRow::of(a.key, a.stats), ResultRow::of(b.key, b.stats));
+}
+
+/// @brief Calls f for every record of the runs, in the order given by before.
+/// @return false if a run could not be opened
+template <typename BEFORE, typename FUNC>
+bool merge_runs(const std::vector<std::string> &files, BEFORE before, FUNC f) {
+    std::vector<std::unique_ptr<RunReader>> runs;
+
+    for (const auto &file : files) {
+        runs.push_back(std::make_unique<RunReader>(file));
+
+        if (!runs.back()->is_open()) return false;
+    }
+
+    // the index of every run which still has records, the next record on top
+    const auto later = [&](std::size_t a, std::size_t b) {
+        return before(*runs[b]->peek(), *runs[a]->peek());
+    };
+
+    std::vector<std::size_t> heap;
+
+    for (std::size_t i = 0; i < runs.size(); i++) {
+        if (runs[i]->peek()) heap.push_back(i);
+    }
+
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+
+        auto &run = *runs[heap.back()];
+
+        if (!f(*run.peek())) return true;
+
+        run.next();
+
+        if (run.peek()) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+
+    return true;
+}
+}  // namespace
+
+SpilledResults::SpilledResults(const std::string &dir, std::size_t max_entries)
+    : max_entries_(std::max<std::size_t>(1, max_entries)) {
+    const auto now = std::chrono::system_clock::now().time_since_epoch().count();
+
+    dir_ = fs::path(dir) / ("analysis-spill-" + std::to_string(now));
+
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+
+    if (ec) {
+        std::cerr << "Error: could not create " << dir_.string() << std::endl;
+        failed_ = true;
+    }
+}
+
+SpilledResults::~SpilledResults() {
+    std::error_code ec;
+    fs::remove_all(dir_, ec);
+}
+
+void SpilledResults::maybe_spill(map_t &stats_map, int concurrency) {
+    std::size_t entries = 0;
+
+    for (std::size_t i = 0; i < stats_map.subcnt(); i++) {
+        stats_map.with_submap(i, [&](const auto &set) { entries += set.size(); });
+    }
+
+    if (entries <= max_entries_) return;
+
+    // another thread is spilling already
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock) return;
+
+    move_to_run(stats_map, concurrency);
+}
+
+void SpilledResults::spill(map_t &stats_map, int concurrency) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    move_to_run(stats_map, concurrency);
+}
+
+void SpilledResults::move_to_run(map_t &stats_map, int concurrency) {
+    Stopwatch watch;
+
+    std::vector<ResultRecord> records;
+    records.reserve(max_entries_ + max_entries_ / 8);
+
+    // a submap is only locked while it is moved, so the analysis goes on meanwhile
+    for (std::size_t i = 0; i < stats_map.subcnt(); i++) {
+        stats_map.with_submap_m(i, [&](auto &set) {
+            for (const auto &[key, stats] : set) records.push_back({key, stats});
+
+            set.clear();
+        });
+    }
+
+    if (!records.empty()) {
+        parallel_sort(records, key_before, concurrency);
+
+        if (!write_run(records, runs_, "keys-")) failed_ = true;
+
+        records_ += records.size();
+    }
+
+    seconds_ += watch.lap();
+}
+
+bool SpilledResults::write_run(const std::vector<ResultRecord> &records,
+                               std::vector<std::string> &runs, const std::string &prefix) {
+    const auto file = (dir_ / (prefix + std::to_string(runs.size()) + ".bin")).string();
+    runs.push_back(file);
+
+    std::FILE *out = std::fopen(file.c_str(), "wb");
+
+    if (!out) {
+        std::cerr << "Error: could not write " << file << std::endl;
+        return false;
+    }
+
+    std::fwrite(records.data(), sizeof(ResultRecord), records.size(), out);
+
+    const bool failed = std::ferror(out);
+
+    if (std::fclose(out) != 0 || failed) {
+        std::cerr << "Error: could not write " << file << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool SpilledResults::write(const std::string &csv_file, const std::string &bin_file,
+                           std::size_t games, std::size_t min_games, std::size_t top_n,
+                           int concurrency, SpillSummary &summary) {
+    if (failed_) return false;
+
+    std::unique_ptr<ResultFileWriter> bin;
+
+    if (!bin_file.empty()) bin = std::make_unique<ResultFileWriter>(bin_file);
+
+    // the rows of the CSV file, sorted in runs of max_entries rows
+    std::vector<std::string> output_runs;
+    std::vector<ResultRecord> rows;
+
+    const auto sort_rows = [&]() {
+        std::vector<ResultRow> order;
+        order.reserve(rows.size());
+
+        for (const auto &record : rows) order.push_back(ResultRow::of(record.key, record.stats));
+
+        // the top_n rows of the whole output are among the top_n rows of each run
+        sort_results(order, top_n, concurrency);
+
+        std::vector<ResultRecord> sorted;
+        sorted.reserve(order.size());
+
+        for (const auto &row : order) sorted.push_back({*row.key, *row.stats});
+
+        return sorted;
+    };
+
+    ResultRecord merged;
+    bool pending = false;
+
+    const auto add = [&](const ResultRecord &record) {
+        summary.totals += record.stats;
+        summary.positions++;
+
+        if (bin) bin->add(record);
+
+        if (record.stats.total() < min_games) return;
+
+        rows.push_back(record);
+
+        if (rows.size() < max_entries_) return;
+
+        if (!write_run(sort_rows(), output_runs, "rows-")) failed_ = true;
+
+        rows.clear();
+    };
+
+    // equal keys come from different runs and follow each other
+    const bool merged_runs = merge_runs(runs_, key_before, [&](const ResultRecord &record) {
+        if (pending && merged.key == record.key) {
+            merged.stats += record.stats;
+            return true;
+        }
+
+        if (pending) add(merged);
+
+        merged  = record;
+        pending = true;
+
+        return !failed_;
+    });
+
+    if (pending) add(merged);
+
+    if (!merged_runs || failed_) {
+        std::cerr << "Error: could not read the runs in " << dir_.string() << std::endl;
+        return false;
+    }
+
+    if (bin && !bin->finish(games)) return false;
+
+    CsvWriter csv(csv_file, concurrency);
+
+    if (!csv.is_open()) {
+        std::cerr << "Error: could not write " << csv_file << std::endl;
+        return false;
+    }
+
+    // everything fit into one run, which never has to go to disk
+    if (output_runs.empty()) {
+        rows = sort_rows();
+
+        std::vector<ResultRow> order;
+        order.reserve(rows.size());
+
+        for (const auto &record : rows) order.push_back(ResultRow::of(record.key, record.stats));
+
+        csv.write(order);
+        summary.written = order.size();
+
+        return csv.close();
+    }
+
+    if (!rows.empty() && !write_run(sort_rows(), output_runs, "rows-")) return false;
+
+    rows.clear();
+    rows.shrink_to_fit();
+
+    std::vector<ResultRecord> block;
+    std::vector<ResultRow> order;
+
+    block.reserve(WRITE_ROWS);
+    order.reserve(WRITE_ROWS);
+
+    const auto flush = [&]() {
+        for (const auto &record : block) order.push_back(ResultRow::of(record.key, record.stats));
+
+        csv.write(order);
+        summary.written += order.size();
+
+        block.clear();
+        order.clear();
+    };
+
+    const bool merged_output = merge_runs(
+        output_runs, output_before, [&](const ResultRecord &record) {
+            if (top_n && summary.written + block.size() == top_n) return false;
+
+            block.push_back(record);
+
+            if (block.size() == WRITE_ROWS) flush();
+
+            return true;
+        });
+
+    flush();
+
+    if (!merged_output) {
+        std::cerr << "Error: could not read the runs in " << dir_.string() << std::endl;
+        return false;
+    }
+
+    return csv.close();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "./result_file.hpp"
+#include "./statistics.hpp"
+
+/// @brief What SpilledResults::write() found while merging.
+struct SpillSummary {
+    Statistics totals;
+    std::size_t positions = 0;
+    std::size_t written   = 0;
+};
+
+/// @brief Bounded memory for --spill. Whenever the map holds more than max_entries positions,
+/// its entries are moved to a run on disk, raw ResultRecords sorted by key. At the end the
+/// runs are combined by a streaming k-way merge, which also sorts the output in runs of
+/// max_entries rows, so that neither the map nor the rows ever hold more than max_entries
+/// entries.
+class SpilledResults {
+   public:
+    /// @brief The runs are kept in a new directory inside dir, it is removed again.
+    /// @param dir
+    /// @param max_entries
+    SpilledResults(const std::string &dir, std::size_t max_entries);
+    ~SpilledResults();
+
+    SpilledResults(const SpilledResults &)            = delete;
+    SpilledResults &operator=(const SpilledResults &) = delete;
+
+    /// @brief Spills the map if it holds more than max_entries positions. Safe to call from
+    /// any thread, the others keep inserting while one thread spills.
+    /// @param stats_map
+    /// @param concurrency
+    void maybe_spill(map_t &stats_map, int concurrency);
+
+    /// @brief Moves all entries of the map to a new run.
+    /// @param stats_map
+    /// @param concurrency
+    void spill(map_t &stats_map, int concurrency);
+
+    [[nodiscard]] std::size_t runs() const noexcept { return runs_.size(); }
+
+    /// @brief Records written to all runs, a position can be part of several runs.
+    [[nodiscard]] std::size_t records() const noexcept { return records_; }
+
+    [[nodiscard]] double seconds() const noexcept { return seconds_; }
+
+    /// @brief Merges the runs, everything has to be spilled before.
+    /// @param csv_file rows with at least min_games games, in the order of sort_results
+    /// @param bin_file result file of all positions, not written if empty
+    /// @param games stored in the result file
+    /// @param min_games
+    /// @param top_n if not 0, only the first top_n rows are written
+    /// @param concurrency
+    /// @param summary
+    /// @return false if a run could not be written or read, or an output could not be written
+    bool write(const std::string &csv_file, const std::string &bin_file, std::size_t games,
+               std::size_t min_games, std::size_t top_n, int concurrency, SpillSummary &summary);
+
+   private:
+    // writes the records as a new run named prefix + index, they have to be sorted already
+    bool write_run(const std::vector<ResultRecord> &records, std::vector<std::string> &runs,
+                   const std::string &prefix);
+
+    // spill() with mutex_ held
+    void move_to_run(map_t &stats_map, int concurrency);
+
+    std::filesystem::path dir_;
+    std::size_t max_entries_;
+
+    std::mutex mutex_;
+    std::vector<std::string> runs_;
+    std::size_t records_ = 0;
+    double seconds_      = 0;
+    bool failed_         = false;
+};
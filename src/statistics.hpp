@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../external/parallel_hashmap/phmap.h"
+#include "./position_key.hpp"
+
+enum class Result { WIN = 'W', DRAW = 'D', LOSS = 'L', UNKNOWN = 'U' };
+
+struct Statistics {
+    size_t wins   = 0;
+    size_t draws  = 0;
+    size_t losses = 0;
+
+    double draw_rate() const { return double(draws) / total(); }
+
+    // for sorting according to draw rate
+
+    bool operator<(const Statistics &other) const {
+        if (draw_rate() == other.draw_rate()) {
+            if (total() == other.total()) {
+                if (wins == other.wins) {
+                    if (draws == other.draws) {
+                        return losses > other.losses;
+                    }
+                    return draws > other.draws;
+                }
+                return wins > other.wins;
+            }
+            return total() > other.total();
+        }
+        return draw_rate() < other.draw_rate();
+    }
+
+    Statistics &operator+=(const Statistics &other) {
+        wins += other.wins;
+        draws += other.draws;
+        losses += other.losses;
+        return *this;
+    }
+
+    size_t total() const { return wins + draws + losses; }
+};
+
+// 2^6 submaps, each guarded by its own mutex
+using map_t = phmap::parallel_flat_hash_map<
+    PositionKey, Statistics, PositionKeyHash, std::equal_to<PositionKey>,
+    std::allocator<std::pair<const PositionKey, Statistics>>, 6, std::mutex>;
+
+/// @brief Adds the statistics of source to target.
+/// @param target
+/// @param source
+inline void merge_into(map_t &target, const map_t &source) {
+    for (const auto &[key, stats] : source) {
+        target.lazy_emplace_l(
+            key, [&](map_t::value_type &v) { v.second += stats; },
+            [&](const map_t::constructor &ctor) { ctor(key, stats); });
+    }
+}
+
+/// @brief Moves the statistics of all sources into target, which is done in parallel by
+/// submap. A key lands in the same submap of every map_t, so no two threads touch the
+/// same submap of target. The sources are left empty.
+/// @param target
+/// @param sources
+/// @param concurrency
+inline void merge_parallel(map_t &target, const std::vector<map_t *> &sources, int concurrency) {
+    const auto merge_submap = [&](std::size_t idx) {
+        target.with_submap_m(idx, [&](auto &dst) {
+            for (auto *source : sources) {
+                source->with_submap_m(idx, [&](auto &src) {
+                    for (const auto &[key, stats] : src) {
+                        bool inserted = false;
+
+                        auto it = dst.lazy_emplace(key, [&](const auto &ctor) {
+                            inserted = true;
+                            ctor(key, stats);
+                        });
+
+                        if (!inserted) it->second += stats;
+                    }
+
+                    src.clear();
+                });
+            }
+        });
+    };
+
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::thread> workers;
+
+    for (int i = 0; i < std::max(1, concurrency); i++) {
+        workers.emplace_back([&]() {
+            for (std::size_t idx = next++; idx < map_t::subcnt(); idx = next++) {
+                merge_submap(idx);
+            }
+        });
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
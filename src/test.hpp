@@ -21,7 +21,7 @@ std::optional<T> get_optional(const nlohmann::json &j, const char *name) {
     }
 }
 
-void from_json(const nlohmann::json &nlohmann_json_j, TestMetaData &nlohmann_json_t) {
+inline void from_json(const nlohmann::json &nlohmann_json_j, TestMetaData &nlohmann_json_t) {
     auto &j = nlohmann_json_j["args"];
 
     nlohmann_json_t.book_depth =
@@ -0,0 +1,184 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../external/json.hpp"
+#include "./run_stats.hpp"
+
+namespace {
+constexpr std::uint64_t NO_DETAIL = std::numeric_limits<std::uint64_t>::max();
+
+// spans kept per thread
+std::size_t capacity = 0;
+
+// the spans of one thread, only that thread writes to it until the trace is written
+struct TraceBuffer {
+    // the role of the thread names it in the trace
+    const ThreadStats *stats = nullptr;
+
+    std::vector<TraceEvent> events;
+
+    // the oldest span once the buffer is full
+    std::size_t next      = 0;
+    std::uint64_t dropped = 0;
+
+    // a ring of the latest details, a new span adds at most one, so the ring never drops a
+    // detail of a span which is still kept
+    std::vector<std::string> details;
+    std::uint64_t detail_count = 0;
+
+    [[nodiscard]] const std::string &detail(std::uint64_t number) const {
+        return details[number % capacity];
+    }
+};
+
+// the buffers of every thread that ever recorded a span, they outlive their threads
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry;
+
+TraceBuffer &thread_buffer() {
+    thread_local TraceBuffer *local = nullptr;
+
+    if (!local) {
+        const auto *stats = &thread_stats();
+
+        const std::lock_guard<std::mutex> lock(registry_mutex);
+
+        // a thread which continues the counters of an ended thread continues its spans as well
+        const auto it = std::find_if(registry.begin(), registry.end(), [stats](const auto &buffer) {
+            return buffer->stats == stats;
+        });
+
+        if (it != registry.end()) {
+            local = it->get();
+        } else {
+            registry.push_back(std::make_unique<TraceBuffer>());
+            local        = registry.back().get();
+            local->stats = stats;
+        }
+    }
+
+    return *local;
+}
+
+// the trace counts in microseconds, with the nanoseconds as decimals
+std::string microseconds(std::int64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f",
+                  static_cast<double>(std::max<std::int64_t>(ns, 0)) / 1e3);
+    return text;
+}
+
+std::string quote(const std::string &text) {
+    // file names need not be valid UTF-8
+    return nlohmann::json(text).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
+}  // namespace
+
+void Trace::enable(std::size_t events_per_thread) {
+    capacity = std::max<std::size_t>(events_per_thread, 1);
+    start_   = std::chrono::steady_clock::now();
+    enabled_ = true;
+}
+
+void Trace::add(const char *name, std::int64_t begin, std::int64_t end, std::string_view detail) {
+    auto &buffer = thread_buffer();
+    auto index   = NO_DETAIL;
+
+    if (!detail.empty()) {
+        if (buffer.detail_count == 0 || buffer.detail(buffer.detail_count - 1) != detail) {
+            // the strings of the ring are assigned again once it is full, which keeps their memory
+            if (buffer.details.size() < capacity) {
+                buffer.details.emplace_back(detail);
+            } else {
+                buffer.details[buffer.detail_count % capacity].assign(detail);
+            }
+
+            buffer.detail_count++;
+        }
+
+        index = buffer.detail_count - 1;
+    }
+
+    const TraceEvent event{name, index, begin, end - begin};
+
+    if (buffer.events.size() < capacity) {
+        buffer.events.push_back(event);
+        return;
+    }
+
+    buffer.events[buffer.next] = event;
+    buffer.next                = (buffer.next + 1) % capacity;
+    buffer.dropped++;
+}
+
+std::uint64_t Trace::dropped() {
+    const std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::uint64_t dropped = 0;
+
+    for (const auto &buffer : registry) dropped += buffer->dropped;
+
+    return dropped;
+}
+
+bool Trace::write(const std::string &file) {
+    std::ofstream os(file, std::ios::trunc);
+
+    if (!os.is_open()) return false;
+
+    const std::lock_guard<std::mutex> lock(registry_mutex);
+
+    const auto role_of = [](const TraceBuffer &buffer) {
+        return buffer.stats->role.empty() ? std::string("thread") : buffer.stats->role;
+    };
+
+    // a role which several threads have is numbered, e.g. "worker 3"
+    std::map<std::string, std::size_t> roles, numbered;
+
+    for (const auto &buffer : registry) roles[role_of(*buffer)]++;
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"analysis\"}}";
+
+    for (std::size_t tid = 0; tid < registry.size(); tid++) {
+        const auto &buffer = *registry[tid];
+        const auto role    = role_of(buffer);
+        auto name          = role;
+
+        if (roles[role] > 1) name += " " + std::to_string(numbered[role]++);
+
+        // the threads are shown in the order they started
+        os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+           << ",\"args\":{\"name\":" << quote(name) << "}}"
+           << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+           << ",\"args\":{\"sort_index\":" << tid << "}}";
+
+        const auto count = buffer.events.size();
+
+        for (std::size_t i = 0; i < count; i++) {
+            const auto &event = buffer.events[(buffer.next + i) % count];
+
+            os << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+               << ",\"ts\":" << microseconds(event.begin)
+               << ",\"dur\":" << microseconds(event.duration);
+
+            if (event.detail != NO_DETAIL) {
+                os << ",\"args\":{\"detail\":" << quote(buffer.detail(event.detail)) << "}";
+            }
+
+            os << "}";
+        }
+    }
+
+    os << "\n]}\n";
+
+    return static_cast<bool>(os);
+}
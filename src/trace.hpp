@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// @brief One span of a thread. The name is a string literal, the detail, e.g. the file of the
+/// span, is kept by the buffer of the thread.
+struct TraceEvent {
+    const char *name;
+
+    // the number of the detail within the thread, counted from the start
+    std::uint64_t detail;
+
+    // nanoseconds since the trace was enabled
+    std::int64_t begin;
+    std::int64_t duration;
+};
+
+/// @brief The spans of --trace. Every thread records into a ring buffer of its own, which is
+/// registered on its first span, so that recording takes no lock and no atomic. Once a buffer
+/// is full its oldest spans are overwritten. The buffers are written as a Chrome trace, which
+/// chrome://tracing and ui.perfetto.dev show as a timeline of the threads.
+class Trace {
+   public:
+    /// @brief Starts the trace, called before any thread of the run is started.
+    /// @param events_per_thread capacity of each ring buffer
+    static void enable(std::size_t events_per_thread);
+
+    [[nodiscard]] static bool enabled() noexcept { return enabled_; }
+
+    /// @brief Nanoseconds since the trace was enabled.
+    [[nodiscard]] static std::int64_t now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start_)
+            .count();
+    }
+
+    /// @brief Records a span of the calling thread.
+    /// @param name a string literal
+    /// @param begin
+    /// @param end
+    /// @param detail shown with the span, consecutive spans with the same detail share a copy,
+    /// a buffer keeps at most as many as it keeps spans
+    static void add(const char *name, std::int64_t begin, std::int64_t end,
+                    std::string_view detail = {});
+
+    /// @brief Records a span of the calling thread which ends now.
+    /// @param name a string literal
+    /// @param seconds
+    static void add_ending_now(const char *name, double seconds) {
+        const auto end = now();
+        add(name, end - static_cast<std::int64_t>(seconds * 1e9), end);
+    }
+
+    /// @brief Writes the spans of all threads, once the threads which record them are done.
+    /// @param file
+    /// @return false if the file could not be written
+    static bool write(const std::string &file);
+
+    /// @brief The spans which were overwritten because a buffer was full.
+    [[nodiscard]] static std::uint64_t dropped();
+
+   private:
+    static inline bool enabled_ = false;
+    static inline std::chrono::steady_clock::time_point start_;
+};
+
+/// @brief A span from construction to destruction, which costs a single branch without --trace.
+class TraceSpan {
+   public:
+    /// @param name a string literal
+    /// @param detail has to outlive the span
+    explicit TraceSpan(const char *name, std::string_view detail = {}) noexcept
+        : name_(name), detail_(detail), begin_(Trace::enabled() ? Trace::now() : -1) {}
+
+    ~TraceSpan() {
+        if (begin_ >= 0) Trace::add(name_, begin_, Trace::now(), detail_);
+    }
+
+    TraceSpan(const TraceSpan &)            = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+   private:
+    const char *name_;
+    std::string_view detail_;
+    std::int64_t begin_;
+};
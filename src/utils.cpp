@@ -3,48 +3,59 @@
 #include <algorithm>
 #include <filesystem>
 #include <string>
+#include <system_error>
 #include <vector>
 
-[[nodiscard]] std::vector<std::string> get_files(const std::string &path, bool recursive) {
-    std::vector<std::string> files;
-
-    for (const auto &entry : std::filesystem::directory_iterator(path)) {
-        if (std::filesystem::is_regular_file(entry)) {
-            std::string stem      = entry.path().stem().string();
-            std::string extension = entry.path().extension().string();
-            if (extension == ".gz") {
-                if (stem.size() >= 4 && stem.substr(stem.size() - 4) == ".pgn") {
-                    files.push_back(entry.path().string());
-                }
-            } else if (extension == ".pgn") {
-                files.push_back(entry.path().string());
+[[nodiscard]] std::vector<PgnJob> plan_jobs(const std::vector<ScannedFile> &pgns, int concurrency,
+                                            bool split) {
+    std::vector<PgnJob> jobs;
+    std::uintmax_t total = 0;
+
+    for (const auto &pgn : pgns) {
+        jobs.push_back({pgn.path, pgn.info.valid ? pgn.info.size : 0});
+        total += jobs.back().size;
+    }
+
+    // a few jobs per thread, but never tiny slices of one file
+    constexpr std::uintmax_t min_slice = std::uintmax_t(64) << 20;
+    const std::uintmax_t slice = std::max(min_slice, total / (4 * std::max(1, concurrency)));
+
+    if (split) {
+        const auto whole_files = jobs.size();
+
+        for (std::size_t i = 0; i < whole_files; i++) {
+            const bool compressed = jobs[i].file.size() >= 3 &&
+                                    jobs[i].file.substr(jobs[i].file.size() - 3) == ".gz";
+
+            if (compressed || jobs[i].size <= slice) continue;
+
+            const auto file = jobs[i];
+
+            jobs[i].size = slice;
+            jobs[i].end  = slice;
+
+            for (std::uintmax_t begin = slice; begin < file.size; begin += slice) {
+                const auto end = std::min(file.size, begin + slice);
+                jobs.push_back({file.file, end - begin, begin, end == file.size ? file.end : end});
             }
-        } else if (recursive && std::filesystem::is_directory(entry)) {
-            auto subdir_files = get_files(entry.path().string(), true);
-            files.insert(files.end(), subdir_files.begin(), subdir_files.end());
         }
     }
 
-    return files;
-}
-
-[[nodiscard]] std::vector<std::vector<std::string>> split_chunks(
-    const std::vector<std::string> &pgns, int target_chunks) {
-    const int chunks_size = (pgns.size() + target_chunks - 1) / target_chunks;
+    std::stable_sort(jobs.begin(), jobs.end(),
+                     [](const auto &a, const auto &b) { return a.size > b.size; });
 
-    auto begin = pgns.begin();
-    auto end   = pgns.end();
+    return jobs;
+}
 
-    std::vector<std::vector<std::string>> chunks;
+[[nodiscard]] std::uint64_t stable_hash(std::string_view data, std::uint64_t seed) {
+    std::uint64_t hash = seed;
 
-    while (begin != end) {
-        auto next =
-            std::next(begin, std::min(chunks_size, static_cast<int>(std::distance(begin, end))));
-        chunks.push_back(std::vector<std::string>(begin, next));
-        begin = next;
+    for (const unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
     }
 
-    return chunks;
+    return hash;
 }
 
 CommandLine::CommandLine(int argc, char const *argv[]) {
@@ -1,12 +1,38 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 
-[[nodiscard]] std::vector<std::string> get_files(const std::string &path, bool recursive = false);
+#include "./file_scan.hpp"
 
-[[nodiscard]] std::vector<std::vector<std::string>> split_chunks(
-    const std::vector<std::string> &pgns, int target_chunks);
+struct PgnJob {
+    std::string file;
+    std::uintmax_t size = 0;
+
+    // byte range of an uncompressed file, a game belongs to the range its header starts in
+    std::size_t begin = 0;
+    std::size_t end   = std::numeric_limits<std::size_t>::max();
+};
+
+/// @brief Turns the files into jobs ordered by size, largest first. Uncompressed files
+/// bigger than the share of one job are split into several byte ranges.
+/// @param pgns the sizes of the scan are used, a file which grew since is still read to its end
+/// @param concurrency
+/// @param split false to always process a file as a whole
+/// @return
+[[nodiscard]] std::vector<PgnJob> plan_jobs(const std::vector<ScannedFile> &pgns, int concurrency,
+                                            bool split);
+
+/// @brief Stable 64 bit FNV-1a hash, which does not change between runs or platforms.
+/// @param data
+/// @param seed
+/// @return
+[[nodiscard]] std::uint64_t stable_hash(std::string_view data,
+                                        std::uint64_t seed = 0xcbf29ce484222325ULL);
 
 class CommandLine {
    public: